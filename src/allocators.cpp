@@ -0,0 +1,252 @@
+#include "allocators.h"
+
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+LockedPageManager* LockedPageManager::_instance = NULL;
+boost::once_flag LockedPageManager::init_flag = BOOST_ONCE_INIT;
+
+/** Determine system page size in bytes */
+static inline size_t GetSystemPageSize()
+{
+    size_t page_size;
+#if defined(PAGESIZE) // defined in limits.h
+    page_size = PAGESIZE;
+#else // assume some POSIX OS
+    page_size = sysconf(_SC_PAGESIZE);
+#endif
+    return page_size;
+}
+
+bool MemoryPageLocker::Lock(const void *addr, size_t len)
+{
+    return mlock(addr, len) == 0;
+}
+
+bool MemoryPageLocker::Unlock(const void *addr, size_t len)
+{
+    return munlock(addr, len) == 0;
+}
+
+LockedPageManager::LockedPageManager() : LockedPageManagerBase<MemoryPageLocker>(GetSystemPageSize())
+{
+}
+
+size_t GetLockedMemoryLimit()
+{
+    struct rlimit rlim;
+    if (getrlimit(RLIMIT_MEMLOCK, &rlim) != 0 || rlim.rlim_cur == RLIM_INFINITY)
+        return (size_t)-1;
+    return rlim.rlim_cur;
+}
+
+//
+// LockedPool
+//
+
+// Regions are mapped and locked whole, then cut into slabs of one size class
+static const size_t REGION_SIZE = 256 * 1024;
+static const size_t SLAB_SIZE = 16 * 1024;
+
+// Size class i holds objects of MIN_OBJECT_SIZE << i bytes
+static const size_t MIN_OBJECT_SIZE = 16;
+
+// Objects per size class a thread may keep, and how many move at once
+// between a thread's cache and the shared lists
+static const unsigned int CACHE_MAX = 64;
+static const unsigned int BATCH = 32;
+
+struct LockedPool::FreeObject
+{
+    FreeObject* next;
+};
+
+class LockedPool::Cache
+{
+public:
+    FreeObject* head[NUM_CLASSES];
+    unsigned int count[NUM_CLASSES];
+
+    Cache()
+    {
+        for (int i = 0; i < NUM_CLASSES; i++)
+        {
+            head[i] = NULL;
+            count[i] = 0;
+        }
+    }
+};
+
+__thread LockedPool::Cache* LockedPool::thread_cache = NULL;
+
+LockedPool::LockedPool() :
+    caches(&LockedPool::ReleaseCache), region_cur(NULL), region_end(NULL)
+{
+    memset(&stats, 0, sizeof(stats));
+    for (int i = 0; i < NUM_CLASSES; i++)
+        central[i] = NULL;
+}
+
+// Smallest class whose objects hold size bytes
+int LockedPool::SizeClass(size_t size)
+{
+    if (size <= MIN_OBJECT_SIZE)
+        return 0;
+    return sizeof(unsigned long) * 8 - __builtin_clzl(size - 1) - 4;
+}
+
+LockedPool::Cache* LockedPool::GetCache()
+{
+    Cache* cache = thread_cache;
+    if (cache == NULL)
+    {
+        cache = new Cache();
+        caches.reset(cache);
+        thread_cache = cache;
+    }
+    return cache;
+}
+
+// Run by boost::thread_specific_ptr when a thread exits: its cached objects
+// go back to the shared lists
+void LockedPool::ReleaseCache(Cache* cache)
+{
+    LockedPool& pool = Instance();
+    for (int cls = 0; cls < NUM_CLASSES; cls++)
+        pool.Flush(cache, cls, cache->count[cls]);
+    if (thread_cache == cache)
+        thread_cache = NULL;
+    delete cache;
+}
+
+void* LockedPool::Allocate(size_t size)
+{
+    if (size > MAX_POOLED_SIZE)
+    {
+        __atomic_fetch_add(&stats.large_allocs, 1, __ATOMIC_RELAXED);
+        void* p = ::operator new(size);
+        LockedPageManager::Instance().LockRange(p, size);
+        return p;
+    }
+
+    int cls = SizeClass(size);
+    Cache* cache = GetCache();
+    if (cache->head[cls] == NULL)
+        Refill(cache, cls);
+
+    FreeObject* obj = cache->head[cls];
+    cache->head[cls] = obj->next;
+    cache->count[cls]--;
+    obj->next = NULL;
+    return obj;
+}
+
+void LockedPool::Free(void* p, size_t size)
+{
+    memory_cleanse(p, size);
+
+    if (size > MAX_POOLED_SIZE)
+    {
+        LockedPageManager::Instance().UnlockRange(p, size);
+        ::operator delete(p);
+        return;
+    }
+
+    int cls = SizeClass(size);
+    Cache* cache = GetCache();
+    FreeObject* obj = static_cast<FreeObject*>(p);
+    obj->next = cache->head[cls];
+    cache->head[cls] = obj;
+    if (++cache->count[cls] > CACHE_MAX)
+        Flush(cache, cls, BATCH);
+}
+
+void LockedPool::Refill(Cache* cache, int cls)
+{
+    boost::mutex::scoped_lock lock(mutex, boost::defer_lock);
+    LockCounted(lock, stats.mutex_contended, stats.mutex_wait_ns);
+    __atomic_fetch_add(&stats.refills, 1, __ATOMIC_RELAXED);
+    if (central[cls] == NULL)
+        CarveSlab(cls);
+
+    for (unsigned int i = 0; i < BATCH && central[cls] != NULL; i++)
+    {
+        FreeObject* obj = central[cls];
+        central[cls] = obj->next;
+        obj->next = cache->head[cls];
+        cache->head[cls] = obj;
+        cache->count[cls]++;
+    }
+}
+
+void LockedPool::Flush(Cache* cache, int cls, unsigned int count)
+{
+    boost::mutex::scoped_lock lock(mutex, boost::defer_lock);
+    LockCounted(lock, stats.mutex_contended, stats.mutex_wait_ns);
+    __atomic_fetch_add(&stats.flushes, 1, __ATOMIC_RELAXED);
+    for (unsigned int i = 0; i < count && cache->head[cls] != NULL; i++)
+    {
+        FreeObject* obj = cache->head[cls];
+        cache->head[cls] = obj->next;
+        cache->count[cls]--;
+        obj->next = central[cls];
+        central[cls] = obj;
+    }
+}
+
+// Called with mutex held
+void LockedPool::CarveSlab(int cls)
+{
+    if ((size_t)(region_end - region_cur) < SLAB_SIZE)
+    {
+        void* p = mmap(NULL, REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            throw std::bad_alloc();
+        if (mlock(p, REGION_SIZE) != 0)
+            __atomic_fetch_add(&stats.lock_failures, 1, __ATOMIC_RELAXED);
+#ifdef MADV_DONTDUMP
+        // Keep keys out of core dumps too
+        madvise(p, REGION_SIZE, MADV_DONTDUMP);
+#endif
+        region_cur = static_cast<char*>(p);
+        region_end = region_cur + REGION_SIZE;
+        __atomic_fetch_add(&stats.mapped_bytes, REGION_SIZE, __ATOMIC_RELAXED);
+    }
+
+    char* slab = region_cur;
+    region_cur += SLAB_SIZE;
+
+    // Linked back to front, so that objects are handed out in address order
+    size_t object_size = MIN_OBJECT_SIZE << cls;
+    for (size_t offset = SLAB_SIZE; offset >= object_size; offset -= object_size)
+    {
+        FreeObject* obj = reinterpret_cast<FreeObject*>(slab + offset - object_size);
+        obj->next = central[cls];
+        central[cls] = obj;
+    }
+}
+
+size_t LockedPool::GetMappedBytes()
+{
+    return __atomic_load_n(&stats.mapped_bytes, __ATOMIC_RELAXED);
+}
+
+bool LockedPool::IsFullyLocked()
+{
+    return __atomic_load_n(&stats.lock_failures, __ATOMIC_RELAXED) == 0;
+}
+
+LockedPoolStats LockedPool::GetStats()
+{
+    LockedPoolStats ret;
+    ret.mapped_bytes = __atomic_load_n(&stats.mapped_bytes, __ATOMIC_RELAXED);
+    ret.lock_failures = __atomic_load_n(&stats.lock_failures, __ATOMIC_RELAXED);
+    ret.refills = __atomic_load_n(&stats.refills, __ATOMIC_RELAXED);
+    ret.flushes = __atomic_load_n(&stats.flushes, __ATOMIC_RELAXED);
+    ret.mutex_contended = __atomic_load_n(&stats.mutex_contended, __ATOMIC_RELAXED);
+    ret.mutex_wait_ns = __atomic_load_n(&stats.mutex_wait_ns, __ATOMIC_RELAXED);
+    ret.large_allocs = __atomic_load_n(&stats.large_allocs, __ATOMIC_RELAXED);
+    return ret;
+}
@@ -7,12 +7,56 @@
 #define BITCOIN_ALLOCATORS_H
 
 #include <map>
+#include <new>
+#include <stdint.h>
 #include <string>
 #include <string.h>
+#include <time.h>
 
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/once.hpp>
-#include <openssl/crypto.h> // for OPENSSL_cleanse()
+#include <boost/thread/tss.hpp>
+
+#include "cleanse.h"
+
+/**
+ * Counters kept by LockedPageManagerBase. They are updated with relaxed
+ * atomics and can be read at any time without taking the manager's mutex.
+ */
+struct LockedPageStats
+{
+    uint64_t lock_calls;      // LockRange() calls
+    uint64_t unlock_calls;    // UnlockRange() calls
+    uint64_t lock_syscalls;   // pages newly locked, i.e. mlock() calls
+    uint64_t unlock_syscalls; // pages unlocked, i.e. munlock() calls
+    uint64_t lock_failures;   // failed mlock() calls, usually RLIMIT_MEMLOCK reached
+    uint64_t mutex_contended; // calls that found the mutex held and had to wait
+    uint64_t mutex_wait_ns;   // total time spent waiting for the mutex
+    uint64_t locked_pages;    // pages currently locked
+};
+
+// Monotonic clock for contention accounting
+inline uint64_t LockedMemoryClockNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Take lock's mutex; if it is held by someone else, add the wait to the
+// contention counters
+inline void LockCounted(boost::mutex::scoped_lock& lock, uint64_t& contended, uint64_t& wait_ns)
+{
+    if (lock.try_lock())
+        return;
+    uint64_t start = LockedMemoryClockNanos();
+    lock.lock();
+    __atomic_fetch_add(&contended, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&wait_ns, LockedMemoryClockNanos() - start, __ATOMIC_RELAXED);
+}
+
+// RLIMIT_MEMLOCK in bytes, or (size_t)-1 if unlimited
+size_t GetLockedMemoryLimit();
 
 /**
  * Thread-safe class to keep track of locked (ie, non-swappable) memory pages.
@@ -34,6 +78,7 @@ public:
         // Determine bitmask for extracting page from address
         assert(!(page_size & (page_size-1))); // size must be power of two
         page_mask = ~(page_size - 1);
+        memset(&stats, 0, sizeof(stats));
     }
 
     ~LockedPageManagerBase()
@@ -45,7 +90,9 @@ public:
     // For all pages in affected range, increase lock count
     void LockRange(void *p, size_t size)
     {
-        boost::mutex::scoped_lock lock(mutex);
+        boost::mutex::scoped_lock lock(mutex, boost::defer_lock);
+        LockCounted(lock, stats.mutex_contended, stats.mutex_wait_ns);
+        Count(stats.lock_calls);
         if(!size) return;
         const size_t base_addr = reinterpret_cast<size_t>(p);
         const size_t start_page = base_addr & page_mask;
@@ -55,7 +102,9 @@ public:
             Histogram::iterator it = histogram.find(page);
             if(it == histogram.end()) // Newly locked page
             {
-                locker.Lock(reinterpret_cast<void*>(page), page_size);
+                Count(stats.lock_syscalls);
+                if (!locker.Lock(reinterpret_cast<void*>(page), page_size))
+                    Count(stats.lock_failures);
                 histogram.insert(std::make_pair(page, 1));
             }
             else // Page was already locked; increase counter
@@ -63,12 +112,15 @@ public:
                 it->second += 1;
             }
         }
+        __atomic_store_n(&stats.locked_pages, histogram.size(), __ATOMIC_RELAXED);
     }
 
     // For all pages in affected range, decrease lock count
     void UnlockRange(void *p, size_t size)
     {
-        boost::mutex::scoped_lock lock(mutex);
+        boost::mutex::scoped_lock lock(mutex, boost::defer_lock);
+        LockCounted(lock, stats.mutex_contended, stats.mutex_wait_ns);
+        Count(stats.unlock_calls);
         if(!size) return;
         const size_t base_addr = reinterpret_cast<size_t>(p);
         const size_t start_page = base_addr & page_mask;
@@ -82,17 +134,32 @@ public:
             if(it->second == 0) // Nothing on the page anymore that keeps it locked
             {
                 // Unlock page and remove the count from histogram
+                Count(stats.unlock_syscalls);
                 locker.Unlock(reinterpret_cast<void*>(page), page_size);
                 histogram.erase(it);
             }
         }
+        __atomic_store_n(&stats.locked_pages, histogram.size(), __ATOMIC_RELAXED);
     }
 
     // Get number of locked pages for diagnostics
     int GetLockedPageCount()
     {
-        boost::mutex::scoped_lock lock(mutex);
-        return histogram.size();
+        return __atomic_load_n(&stats.locked_pages, __ATOMIC_RELAXED);
+    }
+
+    LockedPageStats GetStats()
+    {
+        LockedPageStats ret;
+        ret.lock_calls = __atomic_load_n(&stats.lock_calls, __ATOMIC_RELAXED);
+        ret.unlock_calls = __atomic_load_n(&stats.unlock_calls, __ATOMIC_RELAXED);
+        ret.lock_syscalls = __atomic_load_n(&stats.lock_syscalls, __ATOMIC_RELAXED);
+        ret.unlock_syscalls = __atomic_load_n(&stats.unlock_syscalls, __ATOMIC_RELAXED);
+        ret.lock_failures = __atomic_load_n(&stats.lock_failures, __ATOMIC_RELAXED);
+        ret.mutex_contended = __atomic_load_n(&stats.mutex_contended, __ATOMIC_RELAXED);
+        ret.mutex_wait_ns = __atomic_load_n(&stats.mutex_wait_ns, __ATOMIC_RELAXED);
+        ret.locked_pages = __atomic_load_n(&stats.locked_pages, __ATOMIC_RELAXED);
+        return ret;
     }
 
 private:
@@ -102,6 +169,12 @@ private:
     // map of page base address to lock count
     typedef std::map<size_t,int> Histogram;
     Histogram histogram;
+    LockedPageStats stats;
+
+    static void Count(uint64_t& counter)
+    {
+        __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+    }
 };
 
 
@@ -169,10 +242,85 @@ template<typename T> void LockObject(const T &t) {
 }
 
 template<typename T> void UnlockObject(const T &t) {
-    OPENSSL_cleanse((void*)(&t), sizeof(T));
+    memory_cleanse((void*)(&t), sizeof(T));
     LockedPageManager::Instance().UnlockRange((void*)(&t), sizeof(T));
 }
 
+/** Counters kept by LockedPool, readable like LockedPageStats. */
+struct LockedPoolStats
+{
+    uint64_t mapped_bytes;    // locked regions obtained from the OS
+    uint64_t lock_failures;   // regions whose mlock() failed
+    uint64_t refills;         // batches handed from the shared lists to a thread
+    uint64_t flushes;         // batches given back by a thread
+    uint64_t mutex_contended; // refills and flushes that had to wait for the mutex
+    uint64_t mutex_wait_ns;   // total time spent waiting
+    uint64_t large_allocs;    // allocations too big for the pool
+};
+
+/**
+ * Pool of locked memory for secure_allocator.
+ *
+ * Memory comes from a few large regions that are mmap()ed and mlock()ed once,
+ * carved into slabs of one size class each (16 to 2048 bytes, powers of two).
+ * Every thread keeps a small free list per size class, and only moves batches
+ * of objects to and from the shared lists under the mutex, so allocating and
+ * freeing usually neither takes a lock nor makes a syscall. Objects are
+ * cleansed when freed. Regions are never given back to the OS.
+ *
+ * Requests larger than MAX_POOLED_SIZE are served from the heap and locked
+ * page by page through LockedPageManager, as before.
+ */
+class LockedPool
+{
+public:
+    static const size_t MAX_POOLED_SIZE = 2048;
+
+    static LockedPool& Instance()
+    {
+        // Never destroyed: secure allocations may be freed during static
+        // deinitialization, and by threads still running at exit
+        static LockedPool* instance = new LockedPool();
+        return *instance;
+    }
+
+    void* Allocate(size_t size);
+
+    // size must be the size given to Allocate()
+    void Free(void* p, size_t size);
+
+    // Bytes of locked regions obtained from the OS, and whether mlock()
+    // succeeded for all of them (it fails when RLIMIT_MEMLOCK is too low;
+    // the memory is still usable but may be swapped)
+    size_t GetMappedBytes();
+    bool IsFullyLocked();
+
+    LockedPoolStats GetStats();
+
+private:
+    class Cache;
+    struct FreeObject;
+
+    LockedPool();
+
+    enum { NUM_CLASSES = 8 };
+
+    static __thread Cache* thread_cache;      // this thread's cache, or NULL
+    boost::thread_specific_ptr<Cache> caches; // owns each thread's cache
+    boost::mutex mutex;
+    FreeObject* central[NUM_CLASSES]; // shared free lists
+    char* region_cur;                 // unused part of the current region
+    char* region_end;
+    LockedPoolStats stats;
+
+    static int SizeClass(size_t size);
+    Cache* GetCache();
+    void Refill(Cache* cache, int cls);
+    void Flush(Cache* cache, int cls, unsigned int count);
+    void CarveSlab(int cls);
+    static void ReleaseCache(Cache* cache);
+};
+
 //
 // Allocator that locks its contents from being paged
 // out of memory and clears its contents before deletion.
@@ -197,27 +345,34 @@ struct secure_allocator : public std::allocator<T>
     template<typename _Other> struct rebind
     { typedef secure_allocator<_Other> other; };
 
-    T* allocate(std::size_t n, const void *hint = 0)
+    T* allocate(std::size_t n, const void * = 0)
     {
-        T *p;
-        p = std::allocator<T>::allocate(n, hint);
-        if (p != NULL)
-            LockedPageManager::Instance().LockRange(p, sizeof(T) * n);
-        return p;
+        if (n > (std::size_t)-1 / sizeof(T))
+            throw std::bad_alloc();
+        return static_cast<T*>(LockedPool::Instance().Allocate(sizeof(T) * n));
     }
 
     void deallocate(T* p, std::size_t n)
     {
         if (p != NULL)
-        {
-            OPENSSL_cleanse(p, sizeof(T) * n);
-            LockedPageManager::Instance().UnlockRange(p, sizeof(T) * n);
-        }
-        std::allocator<T>::deallocate(p, n);
+            LockedPool::Instance().Free(p, sizeof(T) * n);
     }
 };
 
 
+/** What zero_after_free_allocator wipes on deallocate() */
+enum WipeMode
+{
+    WIPE_ALL,           // the whole buffer
+    WIPE_TOUCHED_PAGES, // skip pages never written, see memory_cleanse_touched()
+};
+
+inline int& ZeroAfterFreeWipeMode()
+{
+    static int mode = WIPE_ALL;
+    return mode;
+}
+
 //
 // Allocator that clears its contents before deletion.
 //
@@ -244,9 +399,27 @@ struct zero_after_free_allocator : public std::allocator<T>
     void deallocate(T* p, std::size_t n)
     {
         if (p != NULL)
-            OPENSSL_cleanse(p, sizeof(T) * n);
+        {
+            if (__atomic_load_n(&ZeroAfterFreeWipeMode(), __ATOMIC_RELAXED) == WIPE_TOUCHED_PAGES)
+                memory_cleanse_touched(p, sizeof(T) * n);
+            else
+                memory_cleanse(p, sizeof(T) * n);
+        }
         std::allocator<T>::deallocate(p, n);
     }
+
+    // Process-wide, for every zero_after_free_allocator<T>. There is no such
+    // mode for secure_allocator: mlock() faults in every page it locks, so
+    // no page of locked memory is ever provably unwritten.
+    static void SetWipeMode(WipeMode mode)
+    {
+        __atomic_store_n(&ZeroAfterFreeWipeMode(), (int)mode, __ATOMIC_RELAXED);
+    }
+
+    static WipeMode GetWipeMode()
+    {
+        return (WipeMode)__atomic_load_n(&ZeroAfterFreeWipeMode(), __ATOMIC_RELAXED);
+    }
 };
 
 // This is exactly like std::string, but with a custom allocator.
@@ -0,0 +1,99 @@
+#include <ios>
+#include <stdlib.h>
+
+#include "arena.h"
+
+using namespace std;
+
+static __thread CArena* pCurrentArena = NULL;
+
+CArena* CArena::Current()
+{
+	return pCurrentArena;
+}
+
+void CArena::SetCurrent(CArena* arena)
+{
+	pCurrentArena = arena;
+}
+
+CArena::CArena(size_t nCapIn, size_t nBlockSizeIn) :
+	nCap(nCapIn), nBlockSize(nBlockSizeIn), nAllocated(0), nReserved(0),
+	pBlock(NULL), pCur(NULL), pEnd(NULL)
+{
+}
+
+CArena::~CArena()
+{
+	for (size_t i = 0; i < vBlocks.size(); i++)
+	{
+		free(vBlocks[i].first);
+	}
+}
+
+char* CArena::NewBlock(size_t nSize)
+{
+	if (nSize > nCap - min(nReserved, nCap))
+	{
+		throw std::ios_base::failure("CArena : allocation exceeds arena cap");
+	}
+
+	char* p = (char*)malloc(nSize);
+
+	if (p == NULL)
+	{
+		throw std::bad_alloc();
+	}
+
+	vBlocks.push_back(make_pair(p, nSize));
+	nReserved += nSize;
+
+	return p;
+}
+
+void* CArena::AllocateSlow(size_t nSize)
+{
+	if (nSize > nBlockSize / 4)
+	{
+		// Big allocations get a block of their own, so that the block being
+		// bumped is not abandoned half full
+		char* p = NewBlock(nSize);
+		nAllocated += nSize;
+		return p;
+	}
+
+	pBlock = NewBlock(nBlockSize);
+	pCur = pBlock + nSize;
+	pEnd = pBlock + nBlockSize;
+	nAllocated += nSize;
+
+	return pBlock;
+}
+
+void CArena::Reset()
+{
+	size_t nKeep = 0;
+
+	for (size_t i = 0; i < vBlocks.size(); i++)
+	{
+		if (vBlocks[i].first == pBlock)
+		{
+			nKeep = vBlocks[i].second;
+		}
+		else
+		{
+			free(vBlocks[i].first);
+		}
+	}
+
+	vBlocks.clear();
+	nAllocated = 0;
+	nReserved = 0;
+
+	if (pBlock != NULL)
+	{
+		vBlocks.push_back(make_pair(pBlock, nKeep));
+		nReserved = nKeep;
+		pCur = pBlock;
+	}
+}
@@ -0,0 +1,208 @@
+#ifndef BITCOIN_ARENA_H
+#define BITCOIN_ARENA_H
+
+#include <assert.h>
+#include <memory>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Bump allocator for short-lived object graphs, such as everything created
+ * while decoding one message or block.
+ *
+ * Allocation is a pointer increment inside large blocks; individual frees are
+ * no-ops (except for the most recent allocation) and everything is released
+ * at once by Reset() or the destructor. The total size of the blocks is
+ * capped: going over the cap throws std::ios_base::failure, the same way a
+ * bogus size read from the stream is rejected.
+ *
+ * Not thread-safe; use one arena per decoding thread.
+ */
+class CArena
+{
+public:
+	explicit CArena(size_t nCapIn, size_t nBlockSizeIn = 64 * 1024);
+	~CArena();
+
+	void* Allocate(size_t nSize, size_t nAlign)
+	{
+		assert(nAlign <= MAX_ALIGN && (nAlign & (nAlign - 1)) == 0);
+		char* p = (char*)(((uintptr_t)pCur + nAlign - 1) & ~(uintptr_t)(nAlign - 1));
+
+		// Aligning can step past pEnd when the block size is not a multiple
+		// of nAlign
+		if (pCur != NULL && p <= pEnd && nSize <= (size_t)(pEnd - p))
+		{
+			pCur = p + nSize;
+			nAllocated += nSize;
+			return p;
+		}
+
+		return AllocateSlow(nSize);
+	}
+
+	// Only the most recent allocation is actually given back
+	void Deallocate(void* p, size_t nSize)
+	{
+		if ((char*)p + nSize == pCur && (char*)p >= pBlock)
+		{
+			pCur = (char*)p;
+			nAllocated -= nSize;
+		}
+	}
+
+	// Release everything allocated so far; keeps one block for reuse
+	void Reset();
+
+	// Bytes handed out, and bytes obtained from the heap
+	size_t GetAllocated() const { return nAllocated; }
+	size_t GetReserved() const  { return nReserved; }
+
+	// The arena set by the innermost CArenaScope on this thread, or NULL
+	static CArena* Current();
+
+private:
+	friend class CArenaScope;
+
+	// Alignment malloc() guarantees for the blocks
+	static const size_t MAX_ALIGN = 16;
+
+	size_t nCap;
+	size_t nBlockSize;
+	size_t nAllocated;
+	size_t nReserved;
+
+	std::vector<std::pair<char*, size_t> > vBlocks;
+	char* pBlock; // block being bumped, or NULL
+	char* pCur;
+	char* pEnd;
+
+	void* AllocateSlow(size_t nSize);
+	char* NewBlock(size_t nSize);
+
+	static void SetCurrent(CArena* arena);
+
+	CArena(const CArena&);
+	CArena& operator=(const CArena&);
+};
+
+/**
+ * Makes an arena the current one for this thread while in scope. Scopes nest.
+ *
+ *	CArena arena(MAX_BLOCK_SIZE * 4);
+ *	{
+ *		CArenaScope scope(arena);
+ *		vRecv >> msg;  // containers using arena_allocator come from arena
+ *		ProcessMessage(msg);
+ *	}
+ *	arena.Reset();
+ */
+class CArenaScope
+{
+public:
+	explicit CArenaScope(CArena& arena) : pPrev(CArena::Current())
+	{
+		CArena::SetCurrent(&arena);
+	}
+
+	~CArenaScope()
+	{
+		CArena::SetCurrent(pPrev);
+	}
+
+private:
+	CArena* pPrev;
+
+	CArenaScope(const CArenaScope&);
+	CArenaScope& operator=(const CArenaScope&);
+};
+
+/**
+ * Allocator that takes its memory from the arena current at the time the
+ * container is constructed, or from the heap if there is none. Copying a
+ * container re-binds the copy to whatever arena is current at that moment,
+ * so data copied out of a decoding scope does not keep pointing into it.
+ * Containers must not outlive the arena they were created in.
+ *
+ * Two allocators are only interchangeable when they use the same arena, so
+ * the allocator travels with the memory on swap and move assignment: a
+ * container swapped with a heap-backed temporary hands its arena memory to
+ * the temporary, instead of the temporary freeing it with operator delete.
+ */
+template<typename T>
+struct arena_allocator
+{
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef T value_type;
+
+	typedef std::false_type is_always_equal;
+	typedef std::true_type propagate_on_container_swap;
+	typedef std::true_type propagate_on_container_move_assignment;
+
+	CArena* arena;
+
+	arena_allocator() throw() : arena(CArena::Current()) {}
+	arena_allocator(const arena_allocator& a) throw() : arena(a.arena) {}
+	template <typename U>
+	arena_allocator(const arena_allocator<U>& a) throw() : arena(a.arena) {}
+	~arena_allocator() throw() {}
+	template<typename _Other> struct rebind
+	{
+		typedef arena_allocator<_Other> other;
+	};
+
+	arena_allocator select_on_container_copy_construction() const
+	{
+		return arena_allocator();
+	}
+
+	T* allocate(std::size_t n)
+	{
+		if (n > (size_t)-1 / sizeof(T))
+		{
+			throw std::bad_alloc();
+		}
+
+		if (arena == NULL)
+		{
+			return (T*)::operator new(sizeof(T) * n);
+		}
+
+		return (T*)arena->Allocate(sizeof(T) * n, __alignof__(T));
+	}
+
+	void deallocate(T* p, std::size_t n)
+	{
+		if (arena == NULL)
+		{
+			::operator delete(p);
+		}
+		else
+		{
+			arena->Deallocate(p, sizeof(T) * n);
+		}
+	}
+};
+
+template<typename T, typename U>
+inline bool operator==(const arena_allocator<T>& a, const arena_allocator<U>& b)
+{
+	return a.arena == b.arena;
+}
+
+template<typename T, typename U>
+inline bool operator!=(const arena_allocator<T>& a, const arena_allocator<U>& b)
+{
+	return a.arena != b.arena;
+}
+
+#endif // BITCOIN_ARENA_H
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <map>
+#include <new>
+#include <string>
+
+#include "bench.h"
+
+using namespace std;
+
+// Allocation counting: every operator new in the process goes through here.
+// A plain counter is updated with relaxed atomics so that it is usable before
+// static initialization and from the multi-threaded benchmarks.
+static uint64_t nAllocCount = 0;
+
+void* operator new(size_t nSize)
+{
+	__atomic_fetch_add(&nAllocCount, 1, __ATOMIC_RELAXED);
+
+	void* p = malloc(nSize ? nSize : 1);
+
+	if (p == NULL)
+	{
+		throw std::bad_alloc();
+	}
+
+	return p;
+}
+
+void* operator new[](size_t nSize)
+{
+	return operator new(nSize);
+}
+
+void operator delete(void* p) throw()
+{
+	free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) throw()
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) throw()
+{
+	free(p);
+}
+
+namespace benchmark
+{
+
+uint64_t GetAllocCount()
+{
+	return __atomic_load_n(&nAllocCount, __ATOMIC_RELAXED);
+}
+
+void CountAllocation()
+{
+	__atomic_fetch_add(&nAllocCount, 1, __ATOMIC_RELAXED);
+}
+
+int64_t GetTimeNanos()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+typedef map<string, BenchFunction> BenchmarkMap;
+
+static BenchmarkMap& Benchmarks()
+{
+	static BenchmarkMap benchmarks;
+	return benchmarks;
+}
+
+State::State(const string& nameIn, double maxElapsedIn) :
+	name(nameIn), maxElapsed(maxElapsedIn), nStartNanos(0), nLastNanos(0),
+	nStartAllocs(0), count(0), countMask(0), nBytesPerIteration(0)
+{
+}
+
+bool State::KeepRunning()
+{
+	// Only look at the clock every countMask+1 iterations so that the
+	// timer does not dominate very short loop bodies.
+	if (count & countMask)
+	{
+		++count;
+		return true;
+	}
+
+	int64_t nNow = GetTimeNanos();
+
+	if (count == 0)
+	{
+		nStartAllocs = GetAllocCount();
+		nStartNanos = nNow;
+	}
+	else
+	{
+		double elapsed = (nNow - nStartNanos) * 1e-9;
+
+		if (elapsed >= maxElapsed)
+		{
+			Report(nNow);
+			return false;
+		}
+
+		// Grow the mask while a single check interval is still short
+		if ((nNow - nLastNanos) * 16 < maxElapsed * 1e9 && countMask < (1 << 20))
+		{
+			countMask = countMask * 2 + 1;
+		}
+	}
+
+	nLastNanos = nNow;
+	++count;
+	return true;
+}
+
+void State::Report(int64_t nEndNanos)
+{
+	uint64_t nAllocs = GetAllocCount() - nStartAllocs;
+	double elapsed = (nEndNanos - nStartNanos) * 1e-9;
+	double nsPerOp = (nEndNanos - nStartNanos) / (double)count;
+	double bytesPerSec = nBytesPerIteration * (double)count / elapsed;
+	double allocsPerOp = nAllocs / (double)count;
+
+	printf("%s,%llu,%.2f,%.0f,%.3f\n", name.c_str(), (unsigned long long)count,
+	       nsPerOp, bytesPerSec, allocsPerOp);
+	fflush(stdout);
+}
+
+BenchRunner::BenchRunner(const string& name, BenchFunction func)
+{
+	Benchmarks().insert(make_pair(name, func));
+}
+
+void BenchRunner::RunAll(const string& strFilter, double maxElapsed)
+{
+	printf("name,iterations,ns_per_op,bytes_per_sec,allocs_per_op\n");
+
+	for (BenchmarkMap::iterator it = Benchmarks().begin();
+	     it != Benchmarks().end(); ++it)
+	{
+		if (it->first.find(strFilter) == string::npos)
+		{
+			continue;
+		}
+
+		State state(it->first, maxElapsed);
+		it->second(state);
+	}
+}
+
+}
+
+// Usage: bench_<name> [filter] [seconds per benchmark]
+int main(int argc, char* argv[])
+{
+	string strFilter = (argc > 1 ? argv[1] : "");
+	double maxElapsed = (argc > 2 ? atof(argv[2]) : 1.0);
+
+	if (maxElapsed <= 0)
+	{
+		fprintf(stderr, "%s: Invalid benchmark time \"%s\".\n", __func__, argv[2]);
+		return 1;
+	}
+
+	benchmark::BenchRunner::RunAll(strFilter, maxElapsed);
+
+	return 0;
+}
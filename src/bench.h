@@ -0,0 +1,75 @@
+#ifndef BITCOIN_BENCH_H
+#define BITCOIN_BENCH_H
+
+#include <stdint.h>
+#include <string>
+
+/**
+ * Minimal micro-benchmark harness shared by the bench_* programs.
+ *
+ * A benchmark is a function taking a State& that runs its body while
+ * KeepRunning() returns true:
+ *
+ *	static void MyBench(benchmark::State& state)
+ *	{
+ *		state.SetBytesPerIteration(sizeof(obj));
+ *		while (state.KeepRunning())
+ *			...;
+ *	}
+ *	BENCHMARK(MyBench);
+ *
+ * Results are printed as CSV (one line per benchmark) so that they can be
+ * diffed and graphed across builds.
+ */
+namespace benchmark
+{
+	class State
+	{
+	public:
+		State(const std::string& nameIn, double maxElapsedIn);
+
+		bool KeepRunning();
+
+		// Payload bytes handled by one iteration, used for bytes/sec
+		void SetBytesPerIteration(uint64_t nBytes)
+		{
+			nBytesPerIteration = nBytes;
+		}
+
+	private:
+		std::string name;
+		double maxElapsed;
+		int64_t nStartNanos;
+		int64_t nLastNanos;
+		uint64_t nStartAllocs;
+		uint64_t count;
+		uint64_t countMask;
+		uint64_t nBytesPerIteration;
+
+		void Report(int64_t nEndNanos);
+	};
+
+	typedef void (*BenchFunction)(State&);
+
+	class BenchRunner
+	{
+	public:
+		BenchRunner(const std::string& name, BenchFunction func);
+
+		// Run every registered benchmark whose name contains strFilter
+		static void RunAll(const std::string& strFilter, double maxElapsed);
+	};
+
+	// Number of operator new calls made by this process so far
+	uint64_t GetAllocCount();
+
+	// Count an allocation that does not go through operator new, e.g. from
+	// a C library's allocation hooks
+	void CountAllocation();
+
+	int64_t GetTimeNanos();
+}
+
+#define BENCHMARK(n) static benchmark::BenchRunner bench_##n(#n, n)
+
+#endif // BITCOIN_BENCH_H
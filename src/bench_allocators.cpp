@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <sys/mman.h>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "allocators.h"
+#include "bench.h"
+#include "cleanse.h"
+
+#include <openssl/crypto.h>
+
+using namespace std;
+
+typedef vector<unsigned char, secure_allocator<unsigned char> > SecureBytes;
+
+// Allocation sizes cycle through keys, small strings and, if nLarge is set,
+// buffers too big for LockedPool
+static size_t AllocSize(size_t i, size_t nLarge)
+{
+	if (nLarge != 0 && i % 8 == 0)
+	{
+		return nLarge;
+	}
+
+	return 32 + (i * 37) % 400;
+}
+
+// What the other threads do while one thread is timed
+static void Churn(const bool* pfStop, unsigned int nSeed, size_t nLarge)
+{
+	vector<SecureBytes> vKeep(64);
+	size_t i = nSeed;
+
+	while (!__atomic_load_n(pfStop, __ATOMIC_RELAXED))
+	{
+		SecureBytes(AllocSize(i, nLarge), 0xa5).swap(vKeep[i % vKeep.size()]);
+		i++;
+	}
+}
+
+static void PrintStats(const char* pszName)
+{
+	LockedPageStats pageStats = LockedPageManager::Instance().GetStats();
+	LockedPoolStats poolStats = LockedPool::Instance().GetStats();
+
+	fprintf(stderr, "# %s: pool mapped=%llu lock_failures=%llu refills=%llu flushes=%llu contended=%llu wait_ms=%.1f large=%llu\n",
+		pszName, (unsigned long long)poolStats.mapped_bytes, (unsigned long long)poolStats.lock_failures,
+		(unsigned long long)poolStats.refills, (unsigned long long)poolStats.flushes,
+		(unsigned long long)poolStats.mutex_contended, poolStats.mutex_wait_ns / 1e6,
+		(unsigned long long)poolStats.large_allocs);
+	fprintf(stderr, "# %s: pages lock_calls=%llu mlock=%llu munlock=%llu lock_failures=%llu contended=%llu wait_ms=%.1f locked_pages=%llu memlock_limit=%lld\n",
+		pszName, (unsigned long long)pageStats.lock_calls, (unsigned long long)pageStats.lock_syscalls,
+		(unsigned long long)pageStats.unlock_syscalls, (unsigned long long)pageStats.lock_failures,
+		(unsigned long long)pageStats.mutex_contended, pageStats.mutex_wait_ns / 1e6,
+		(unsigned long long)pageStats.locked_pages, (long long)GetLockedMemoryLimit());
+}
+
+// One secure allocation and free per iteration, timed on this thread while
+// nThreads - 1 others do the same
+static void SecureAllocStress(benchmark::State& state, const char* pszName, unsigned int nThreads, size_t nLarge)
+{
+	bool fStop = false;
+	boost::thread_group threads;
+
+	for (unsigned int t = 1; t < nThreads; t++)
+	{
+		threads.create_thread(boost::bind(Churn, &fStop, t * 1000, nLarge));
+	}
+
+	vector<SecureBytes> vKeep(64);
+	size_t i = 0;
+
+	while (state.KeepRunning())
+	{
+		SecureBytes(AllocSize(i, nLarge), 0x5a).swap(vKeep[i % vKeep.size()]);
+		i++;
+	}
+
+	__atomic_store_n(&fStop, true, __ATOMIC_RELAXED);
+	threads.join_all();
+
+	PrintStats(pszName);
+}
+
+static void SecureAlloc1Thread(benchmark::State& state) { SecureAllocStress(state, "SecureAlloc1Thread", 1, 0); }
+static void SecureAlloc2Threads(benchmark::State& state) { SecureAllocStress(state, "SecureAlloc2Threads", 2, 0); }
+static void SecureAlloc4Threads(benchmark::State& state) { SecureAllocStress(state, "SecureAlloc4Threads", 4, 0); }
+static void SecureAlloc8Threads(benchmark::State& state) { SecureAllocStress(state, "SecureAlloc8Threads", 8, 0); }
+// Every eighth allocation goes through LockedPageManager
+static void SecureAllocLarge4Threads(benchmark::State& state) { SecureAllocStress(state, "SecureAllocLarge4Threads", 4, 8192); }
+
+BENCHMARK(SecureAlloc1Thread);
+BENCHMARK(SecureAlloc2Threads);
+BENCHMARK(SecureAlloc4Threads);
+BENCHMARK(SecureAlloc8Threads);
+BENCHMARK(SecureAllocLarge4Threads);
+
+// Wipe throughput by buffer size, against the OpenSSL routine it replaced
+static void CleanseBench(benchmark::State& state, size_t nSize, bool fOpenSSL)
+{
+	vector<unsigned char> vch(nSize, 0x5a);
+	state.SetBytesPerIteration(nSize);
+
+	while (state.KeepRunning())
+	{
+		if (fOpenSSL)
+			OPENSSL_cleanse(&vch[0], nSize);
+		else
+			memory_cleanse(&vch[0], nSize);
+	}
+}
+
+static void Cleanse64(benchmark::State& state) { CleanseBench(state, 64, false); }
+static void Cleanse4K(benchmark::State& state) { CleanseBench(state, 4096, false); }
+static void Cleanse64K(benchmark::State& state) { CleanseBench(state, 65536, false); }
+static void Cleanse1M(benchmark::State& state) { CleanseBench(state, 1 << 20, false); }
+static void OpenSSLCleanse64(benchmark::State& state) { CleanseBench(state, 64, true); }
+static void OpenSSLCleanse4K(benchmark::State& state) { CleanseBench(state, 4096, true); }
+static void OpenSSLCleanse64K(benchmark::State& state) { CleanseBench(state, 65536, true); }
+static void OpenSSLCleanse1M(benchmark::State& state) { CleanseBench(state, 1 << 20, true); }
+
+BENCHMARK(Cleanse64);
+BENCHMARK(Cleanse4K);
+BENCHMARK(Cleanse64K);
+BENCHMARK(Cleanse1M);
+BENCHMARK(OpenSSLCleanse64);
+BENCHMARK(OpenSSLCleanse4K);
+BENCHMARK(OpenSSLCleanse64K);
+BENCHMARK(OpenSSLCleanse1M);
+
+// A fresh 8 MiB mapping of which only the first 1 MiB was written, as when
+// a large serialization buffer is freed: full wipe vs. touched pages only
+static void CleanseSparseBench(benchmark::State& state, bool fTouched)
+{
+	const size_t nSize = 8 << 20;
+	const size_t nUsed = 1 << 20;
+	state.SetBytesPerIteration(nSize);
+
+	while (state.KeepRunning())
+	{
+		void* p = mmap(NULL, nSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			break;
+		memset(p, 0x5a, nUsed);
+
+		if (fTouched)
+			memory_cleanse_touched(p, nSize);
+		else
+			memory_cleanse(p, nSize);
+		munmap(p, nSize);
+	}
+}
+
+static void CleanseSparse8M(benchmark::State& state) { CleanseSparseBench(state, false); }
+static void CleanseTouchedSparse8M(benchmark::State& state) { CleanseSparseBench(state, true); }
+
+BENCHMARK(CleanseSparse8M);
+BENCHMARK(CleanseTouchedSparse8M);
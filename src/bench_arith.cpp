@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include <openssl/crypto.h>
+
+#include "bench.h"
+#include "bignum.h"
+#include "uint256.h"
+
+using namespace std;
+
+// Route OpenSSL's allocations through the benchmark's counter, so that
+// allocs_per_op includes every BIGNUM and BN_CTX allocation
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+static void* CountingMalloc(size_t nSize)
+{
+	benchmark::CountAllocation();
+	return malloc(nSize);
+}
+
+static void* CountingRealloc(void* p, size_t nSize)
+{
+	benchmark::CountAllocation();
+	return realloc(p, nSize);
+}
+
+static void CountingFree(void* p)
+{
+	free(p);
+}
+#else
+static void* CountingMalloc(size_t nSize, const char*, int)
+{
+	benchmark::CountAllocation();
+	return malloc(nSize);
+}
+
+static void* CountingRealloc(void* p, size_t nSize, const char*, int)
+{
+	benchmark::CountAllocation();
+	return realloc(p, nSize);
+}
+
+static void CountingFree(void* p, const char*, int)
+{
+	free(p);
+}
+#endif
+
+// Must run before OpenSSL allocates anything
+static const int fCountingOpenSSL = CRYPTO_set_mem_functions(CountingMalloc, CountingRealloc, CountingFree);
+
+// Difficulty target changes every 2016 blocks by at most a factor of 4
+static const int64_t nTargetTimespan = 14 * 24 * 60 * 60;
+
+// nBits of a synthetic header chain: exponents and mantissas spread over the
+// range seen on main net
+static const vector<unsigned int>& HeaderBits()
+{
+	static vector<unsigned int> vBits;
+
+	if (vBits.empty())
+	{
+		uint32_t nSeed = 1;
+		for (int i = 0; i < 100000; i++)
+		{
+			nSeed = nSeed * 1103515245 + 12345;
+			unsigned int nSize = 0x17 + (nSeed >> 8) % 7;
+			unsigned int nWord = 0x008000 + (nSeed >> 12) % 0x7f8000;
+			vBits.push_back(nSize << 24 | nWord);
+		}
+	}
+
+	return vBits;
+}
+
+// Print what a benchmark computed, so that the optimizer cannot drop the
+// work of the fully inlined uint256 versions
+static void PrintResult(const char* pszName, const std::string& strResult)
+{
+	fprintf(stderr, "# %s: %s\n", pszName, strResult.c_str());
+}
+
+static void PrintResult(const char* pszName, unsigned int nResult)
+{
+	fprintf(stderr, "# %s: %08x\n", pszName, nResult);
+}
+
+// Work of one header, accumulated into a chain total: 2^256 / (target + 1)
+static void ChainWorkBigNum(benchmark::State& state)
+{
+	const vector<unsigned int>& vBits = HeaderBits();
+	CBigNum bnChainWork = 0;
+	size_t i = 0;
+
+	while (state.KeepRunning())
+	{
+		CBigNum bnTarget;
+		bnTarget.SetCompact(vBits[i]);
+		bnChainWork += (CBigNum(1) << 256) / (bnTarget + 1);
+
+		if (++i == vBits.size())
+		{
+			i = 0;
+		}
+	}
+
+	PrintResult("ChainWorkBigNum", bnChainWork.GetHex());
+}
+
+// Same, with one BN_CTX held for the whole loop
+static void ChainWorkBigNumScoped(benchmark::State& state)
+{
+	const vector<unsigned int>& vBits = HeaderBits();
+	CBN_CTXScope scope;
+	CBigNum bnChainWork = 0;
+	size_t i = 0;
+
+	while (state.KeepRunning())
+	{
+		CBigNum bnTarget;
+		bnTarget.SetCompact(vBits[i]);
+		bnChainWork += (CBigNum(1) << 256) / (bnTarget + 1);
+
+		if (++i == vBits.size())
+		{
+			i = 0;
+		}
+	}
+
+	PrintResult("ChainWorkBigNumScoped", bnChainWork.GetHex());
+}
+
+static void ChainWorkNative(benchmark::State& state)
+{
+	const vector<unsigned int>& vBits = HeaderBits();
+	uint256 nChainWork = 0;
+	size_t i = 0;
+
+	while (state.KeepRunning())
+	{
+		uint256 nTarget;
+		nTarget.SetCompact(vBits[i]);
+		// 2^256 does not fit, but 2^256 / (target + 1) == ~target / (target + 1) + 1
+		nChainWork += (~nTarget / (nTarget + 1)) + 1;
+
+		if (++i == vBits.size())
+		{
+			i = 0;
+		}
+	}
+
+	PrintResult("ChainWorkNative", nChainWork.GetHex());
+}
+
+BENCHMARK(ChainWorkBigNum);
+BENCHMARK(ChainWorkBigNumScoped);
+BENCHMARK(ChainWorkNative);
+
+// A difficulty retarget: scale the old target by the actual timespan
+static void RetargetBigNum(benchmark::State& state)
+{
+	const vector<unsigned int>& vBits = HeaderBits();
+	CBigNum bnLimit = CBigNum(~uint256(0) >> 32);
+	unsigned int nBits = 0;
+	size_t i = 0;
+
+	while (state.KeepRunning())
+	{
+		int64_t nActualTimespan = nTargetTimespan / 4 + i % (nTargetTimespan * 15 / 4 + 1);
+		CBigNum bnNew;
+		bnNew.SetCompact(vBits[i]);
+		bnNew *= nActualTimespan;
+		bnNew /= nTargetTimespan;
+		if (bnNew > bnLimit)
+		{
+			bnNew = bnLimit;
+		}
+		nBits += bnNew.GetCompact();
+
+		if (++i == vBits.size())
+		{
+			i = 0;
+		}
+	}
+
+	PrintResult("RetargetBigNum", nBits);
+}
+
+static void RetargetNative(benchmark::State& state)
+{
+	const vector<unsigned int>& vBits = HeaderBits();
+	uint256 nLimit = ~uint256(0) >> 32;
+	unsigned int nBits = 0;
+	size_t i = 0;
+
+	while (state.KeepRunning())
+	{
+		int64_t nActualTimespan = nTargetTimespan / 4 + i % (nTargetTimespan * 15 / 4 + 1);
+		uint256 nNew;
+		nNew.SetCompact(vBits[i]);
+		nNew *= (uint32_t)nActualTimespan;
+		nNew /= uint256(nTargetTimespan);
+		if (nNew > nLimit)
+		{
+			nNew = nLimit;
+		}
+		nBits += nNew.GetCompact();
+
+		if (++i == vBits.size())
+		{
+			i = 0;
+		}
+	}
+
+	PrintResult("RetargetNative", nBits);
+}
+
+BENCHMARK(RetargetBigNum);
+BENCHMARK(RetargetNative);
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "bench.h"
+#include "core.h"
+#include "hashmap.h"
+#include "sortedhash.h"
+#include "uint256.h"
+
+using namespace std;
+
+// Roughly the number of outputs touched by a large block
+static const size_t nKeys = 1 << 16;
+
+static const vector<uint256>& Keys()
+{
+	static vector<uint256> vKeys;
+
+	if (vKeys.empty())
+	{
+		uint64_t nSeed = 1;
+		for (size_t i = 0; i < nKeys; i++)
+		{
+			uint256 hash;
+			for (unsigned int j = 0; j < hash.size(); j++)
+			{
+				nSeed = nSeed * 6364136223846793005ULL + 1442695040888963407ULL;
+				hash.begin()[j] = nSeed >> 56;
+			}
+			vKeys.push_back(hash);
+		}
+	}
+
+	return vKeys;
+}
+
+template<typename Map>
+static void FindUint256(benchmark::State& state)
+{
+	const vector<uint256>& vKeys = Keys();
+	Map m;
+	for (size_t i = 0; i < vKeys.size(); i++)
+	{
+		m[vKeys[i]] = i;
+	}
+
+	size_t i = 0;
+	size_t nFound = 0;
+	while (state.KeepRunning())
+	{
+		nFound += m.find(vKeys[i])->second;
+		i = (i + 7919) % vKeys.size();
+	}
+}
+
+template<typename Map>
+static void InsertUint256(benchmark::State& state)
+{
+	const vector<uint256>& vKeys = Keys();
+	Map m;
+	size_t i = 0;
+
+	while (state.KeepRunning())
+	{
+		m[vKeys[i]] = i;
+		if (++i == vKeys.size())
+		{
+			i = 0;
+			m.clear();
+		}
+	}
+}
+
+template<typename Set>
+static void FindOutPoint(benchmark::State& state)
+{
+	const vector<uint256>& vKeys = Keys();
+	Set s;
+	for (size_t i = 0; i < vKeys.size(); i++)
+	{
+		s.insert(COutPoint(vKeys[i / 4], i % 4));
+	}
+
+	size_t i = 0;
+	size_t nFound = 0;
+	while (state.KeepRunning())
+	{
+		nFound += s.count(COutPoint(vKeys[i / 4], i % 4));
+		i = (i + 7919) % vKeys.size();
+	}
+}
+
+static void MapFindUint256(benchmark::State& state) { FindUint256<map<uint256, size_t> >(state); }
+static void HashMapFindUint256(benchmark::State& state) { FindUint256<CHashMap<uint256, size_t> >(state); }
+static void MapInsertUint256(benchmark::State& state) { InsertUint256<map<uint256, size_t> >(state); }
+static void HashMapInsertUint256(benchmark::State& state) { InsertUint256<CHashMap<uint256, size_t> >(state); }
+static void SetFindOutPoint(benchmark::State& state) { FindOutPoint<set<COutPoint> >(state); }
+static void HashSetFindOutPoint(benchmark::State& state) { FindOutPoint<CHashSet<COutPoint> >(state); }
+
+// Sorting a copy of the keys, per key
+static void StdSortUint256(benchmark::State& state)
+{
+	const vector<uint256>& vKeys = Keys();
+	vector<uint256> v;
+
+	while (state.KeepRunning())
+	{
+		if (v.empty())
+		{
+			v = vKeys;
+			sort(v.begin(), v.end());
+		}
+		v.pop_back();
+	}
+}
+
+static void RadixSortUint256(benchmark::State& state)
+{
+	const vector<uint256>& vKeys = Keys();
+	vector<uint256> v;
+
+	while (state.KeepRunning())
+	{
+		if (v.empty())
+		{
+			v = vKeys;
+			SortHashes(v);
+		}
+		v.pop_back();
+	}
+}
+
+static void VectorLowerBoundUint256(benchmark::State& state)
+{
+	vector<uint256> v = Keys();
+	sort(v.begin(), v.end());
+
+	size_t i = 0;
+	size_t nPos = 0;
+	while (state.KeepRunning())
+	{
+		nPos += lower_bound(v.begin(), v.end(), Keys()[i]) - v.begin();
+		i = (i + 7919) % v.size();
+	}
+}
+
+static void SortedSetLowerBoundUint256(benchmark::State& state)
+{
+	CSortedHashSet<uint256> s(Keys());
+
+	size_t i = 0;
+	size_t nPos = 0;
+	while (state.KeepRunning())
+	{
+		nPos += s.lower_bound(Keys()[i]);
+		i = (i + 7919) % s.size();
+	}
+}
+
+// Per key, in batches of 256
+static void SortedSetBatchLowerBoundUint256(benchmark::State& state)
+{
+	const vector<uint256>& vKeys = Keys();
+	CSortedHashSet<uint256> s(vKeys);
+	size_t vPos[256];
+
+	size_t i = 0;
+	size_t j = 256;
+	while (state.KeepRunning())
+	{
+		if (j == 256)
+		{
+			s.lower_bound(&vKeys[i], 256, vPos);
+			i = (i + 256) % vKeys.size();
+			j = 0;
+		}
+		j++;
+	}
+}
+
+BENCHMARK(MapFindUint256);
+BENCHMARK(HashMapFindUint256);
+BENCHMARK(MapInsertUint256);
+BENCHMARK(HashMapInsertUint256);
+BENCHMARK(SetFindOutPoint);
+BENCHMARK(HashSetFindOutPoint);
+BENCHMARK(StdSortUint256);
+BENCHMARK(RadixSortUint256);
+BENCHMARK(VectorLowerBoundUint256);
+BENCHMARK(SortedSetLowerBoundUint256);
+BENCHMARK(SortedSetBatchLowerBoundUint256);
@@ -0,0 +1,465 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <boost/tuple/tuple.hpp>
+
+#include "arena.h"
+#include "bench.h"
+#include "serialize.h"
+#include "uint256.h"
+#include "version.h"
+
+using namespace std;
+
+// Roughly the size of a full block
+static const size_t BLOCK_STREAM_SIZE = 4 * 1000 * 1000;
+
+static const vector<char>& BlockBytes()
+{
+	static vector<char> vchBlock;
+
+	if (vchBlock.empty())
+	{
+		vchBlock.resize(BLOCK_STREAM_SIZE);
+		for (size_t i = 0; i < vchBlock.size(); i++)
+		{
+			vchBlock[i] = (char)(i * 131);
+		}
+	}
+
+	return vchBlock;
+}
+
+// Fill and release a block-sized stream; the release scrubs the buffer
+template<typename Stream>
+static void BlockStreamRelease(benchmark::State& state)
+{
+	const vector<char>& vchBlock = BlockBytes();
+
+	state.SetBytesPerIteration(vchBlock.size());
+
+	while (state.KeepRunning())
+	{
+		Stream ss(SER_DISK, PROTOCOL_VERSION);
+		ss.write(&vchBlock[0], vchBlock.size());
+	}
+}
+
+static void DataStreamBlockRelease(benchmark::State& state)
+{
+	BlockStreamRelease<CDataStream>(state);
+}
+
+static void PublicDataStreamBlockRelease(benchmark::State& state)
+{
+	BlockStreamRelease<CPublicDataStream>(state);
+}
+
+BENCHMARK(DataStreamBlockRelease);
+BENCHMARK(PublicDataStreamBlockRelease);
+
+// A transaction-like object: many small, individually written byte vectors
+static const vector<vector<unsigned char> >& ScriptList()
+{
+	static vector<vector<unsigned char> > vScripts;
+
+	if (vScripts.empty())
+	{
+		vScripts.resize(2000, vector<unsigned char>(107, 0x51));
+	}
+
+	return vScripts;
+}
+
+static void DataStreamAppend(benchmark::State& state)
+{
+	const vector<vector<unsigned char> >& vScripts = ScriptList();
+
+	state.SetBytesPerIteration(GetSerializeSize(vScripts, SER_NETWORK, PROTOCOL_VERSION));
+
+	while (state.KeepRunning())
+	{
+		CPublicDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+		ss << vScripts;
+	}
+}
+
+static void DataStreamPresized(benchmark::State& state)
+{
+	const vector<vector<unsigned char> >& vScripts = ScriptList();
+
+	state.SetBytesPerIteration(GetSerializeSize(vScripts, SER_NETWORK, PROTOCOL_VERSION));
+
+	while (state.KeepRunning())
+	{
+		CPublicDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+		ss.SerializePresized(vScripts);
+	}
+}
+
+BENCHMARK(DataStreamAppend);
+BENCHMARK(DataStreamPresized);
+
+//
+// One group of benchmarks per template family in serialize.h, each run
+// against the in-memory stream and both file streams:
+//
+//	<Family>_DataStreamWrite    CDataStream << obj
+//	<Family>_DataStreamRead     CDataStream >> obj
+//	<Family>_AutoFileWrite      CAutoFile << obj
+//	<Family>_AutoFileRead       CAutoFile >> obj
+//	<Family>_BufferedFileRead   CBufferedFile >> obj
+//
+// One iteration (de)serializes one object. File benchmarks cycle through a
+// temporary file holding a few MB of copies of the object.
+//
+
+// How much data the file benchmarks stream through before rewinding
+static const size_t FILE_STREAM_SIZE = 4 * 1000 * 1000;
+
+// A batch of CompactSize values covering every length ReadCompactSize()
+// accepts (the 9-byte form is above MAX_SIZE)
+class CCompactSizeBatch
+{
+public:
+	uint64_t n[64];
+
+	CCompactSizeBatch()
+	{
+		for (int i = 0; i < 64; i++)
+		{
+			n[i] = (i % 3 == 0 ? i : i % 3 == 1 ? 0xfd + i : 0x10000 + i);
+		}
+	}
+
+	unsigned int GetSerializeSize(int, int) const
+	{
+		unsigned int nSize = 0;
+		for (int i = 0; i < 64; i++)
+		{
+			nSize += GetSizeOfCompactSize(n[i]);
+		}
+		return nSize;
+	}
+
+	template<typename Stream>
+	void Serialize(Stream& s, int, int) const
+	{
+		for (int i = 0; i < 64; i++)
+		{
+			WriteCompactSize(s, n[i]);
+		}
+	}
+
+	template<typename Stream>
+	void Unserialize(Stream& s, int, int)
+	{
+		for (int i = 0; i < 64; i++)
+		{
+			n[i] = ReadCompactSize(s);
+		}
+	}
+};
+
+// A batch of VarInts, from one byte up to the full 64 bits
+class CVarIntBatch
+{
+public:
+	uint64_t n[64];
+
+	CVarIntBatch()
+	{
+		for (int i = 0; i < 64; i++)
+		{
+			n[i] = ((uint64_t)1 << i) + i;
+		}
+	}
+
+	IMPLEMENT_SERIALIZE
+	(
+		for (int i = 0; i < 64; i++)
+		{
+			READWRITE(VARINT(n[i]));
+		}
+	)
+};
+
+// A block header sized blob written with FLATDATA
+class CFlatHeader
+{
+public:
+	char data[80];
+
+	CFlatHeader()
+	{
+		for (int i = 0; i < 80; i++)
+		{
+			data[i] = (char)(i * 7);
+		}
+	}
+
+	IMPLEMENT_SERIALIZE
+	(
+		READWRITE(FLATDATA(data));
+	)
+};
+
+static uint256 HashN(int n)
+{
+	uint256 hash;
+	for (unsigned char* p = hash.begin(); p != hash.end(); p++)
+	{
+		*p = (unsigned char)(n * 31 + (p - hash.begin()) * 17);
+	}
+	return hash;
+}
+
+static string MakeString()
+{
+	return string(100, 'a');
+}
+
+static vector<int> MakeIntVector()
+{
+	vector<int> v(1000);
+	for (size_t i = 0; i < v.size(); i++)
+	{
+		v[i] = i;
+	}
+	return v;
+}
+
+static vector<vector<unsigned char> > MakeScriptVector()
+{
+	return vector<vector<unsigned char> >(100, vector<unsigned char>(107, 0x51));
+}
+
+static pair<int, string> MakePair()
+{
+	return make_pair(42, string(32, 'p'));
+}
+
+static boost::tuple<int64_t, uint256, string> MakeTuple()
+{
+	return boost::make_tuple((int64_t)5000000000LL, HashN(1), string(32, 't'));
+}
+
+static map<int, string> MakeMap()
+{
+	map<int, string> m;
+	for (int i = 0; i < 100; i++)
+	{
+		m[i] = string(16, 'm');
+	}
+	return m;
+}
+
+static set<uint256> MakeSet()
+{
+	set<uint256> s;
+	for (int i = 0; i < 100; i++)
+	{
+		s.insert(HashN(i));
+	}
+	return s;
+}
+
+template<typename T>
+static void DataStreamWrite(benchmark::State& state, const T& obj)
+{
+	CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+
+	state.SetBytesPerIteration(GetSerializeSize(obj, SER_DISK, PROTOCOL_VERSION));
+
+	while (state.KeepRunning())
+	{
+		ss.clear();
+		ss << obj;
+	}
+}
+
+template<typename T>
+static void DataStreamRead(benchmark::State& state, const T& obj)
+{
+	unsigned int nSize = GetSerializeSize(obj, SER_DISK, PROTOCOL_VERSION);
+	T objRead;
+
+	// Two copies, so that reading one never reaches the end and compacts the buffer
+	CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+	ss << obj << obj;
+
+	state.SetBytesPerIteration(nSize);
+
+	while (state.KeepRunning())
+	{
+		ss >> objRead;
+		ss.Rewind(nSize);
+	}
+}
+
+static unsigned int FileCopies(unsigned int nSize)
+{
+	return max(FILE_STREAM_SIZE / max(nSize, 1U), (size_t)1);
+}
+
+template<typename T>
+static FILE* TempFileWithCopies(const T& obj, unsigned int nCopies)
+{
+	FILE* file = tmpfile();
+	if (file == NULL)
+	{
+		throw runtime_error("tmpfile failed");
+	}
+
+	CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+	ss << obj;
+
+	for (unsigned int i = 0; i < nCopies; i++)
+	{
+		fwrite(&ss[0], 1, ss.size(), file);
+	}
+
+	fflush(file);
+	rewind(file);
+
+	return file;
+}
+
+template<typename T>
+static void AutoFileWrite(benchmark::State& state, const T& obj)
+{
+	unsigned int nSize = GetSerializeSize(obj, SER_DISK, PROTOCOL_VERSION);
+	unsigned int nCopies = FileCopies(nSize);
+	unsigned int nWritten = 0;
+
+	CAutoFile file(tmpfile(), SER_DISK, PROTOCOL_VERSION);
+	if (!file)
+	{
+		throw runtime_error("tmpfile failed");
+	}
+
+	state.SetBytesPerIteration(nSize);
+
+	while (state.KeepRunning())
+	{
+		file << obj;
+
+		if (++nWritten == nCopies)
+		{
+			rewind(file);
+			nWritten = 0;
+		}
+	}
+}
+
+template<typename T>
+static void AutoFileRead(benchmark::State& state, const T& obj)
+{
+	unsigned int nSize = GetSerializeSize(obj, SER_DISK, PROTOCOL_VERSION);
+	unsigned int nCopies = FileCopies(nSize);
+	unsigned int nRead = 0;
+	T objRead;
+
+	CAutoFile file(TempFileWithCopies(obj, nCopies), SER_DISK, PROTOCOL_VERSION);
+
+	state.SetBytesPerIteration(nSize);
+
+	while (state.KeepRunning())
+	{
+		file >> objRead;
+
+		if (++nRead == nCopies)
+		{
+			rewind(file);
+			nRead = 0;
+		}
+	}
+}
+
+template<typename T>
+static void BufferedFileRead(benchmark::State& state, const T& obj)
+{
+	unsigned int nSize = GetSerializeSize(obj, SER_DISK, PROTOCOL_VERSION);
+	unsigned int nCopies = FileCopies(nSize);
+	unsigned int nRead = 0;
+	T objRead;
+
+	FILE* file = TempFileWithCopies(obj, nCopies);
+
+	{
+		CBufferedFile blkdat(file, max(2 * nSize, 1U << 20), 0, SER_DISK, PROTOCOL_VERSION);
+
+		state.SetBytesPerIteration(nSize);
+
+		while (state.KeepRunning())
+		{
+			blkdat >> objRead;
+
+			if (++nRead == nCopies)
+			{
+				blkdat.Seek(0);
+				nRead = 0;
+			}
+		}
+	}
+
+	fclose(file);
+}
+
+#define SERIALIZE_BENCHMARKS(family, obj) \
+	static void family##_DataStreamWrite(benchmark::State& state) { DataStreamWrite(state, obj); } \
+	static void family##_DataStreamRead(benchmark::State& state) { DataStreamRead(state, obj); } \
+	static void family##_AutoFileWrite(benchmark::State& state) { AutoFileWrite(state, obj); } \
+	static void family##_AutoFileRead(benchmark::State& state) { AutoFileRead(state, obj); } \
+	static void family##_BufferedFileRead(benchmark::State& state) { BufferedFileRead(state, obj); } \
+	BENCHMARK(family##_DataStreamWrite); \
+	BENCHMARK(family##_DataStreamRead); \
+	BENCHMARK(family##_AutoFileWrite); \
+	BENCHMARK(family##_AutoFileRead); \
+	BENCHMARK(family##_BufferedFileRead)
+
+SERIALIZE_BENCHMARKS(Int32, (int32_t)0x12345678);
+SERIALIZE_BENCHMARKS(Int64, (int64_t)0x123456789abcdefLL);
+SERIALIZE_BENCHMARKS(CompactSize, CCompactSizeBatch());
+SERIALIZE_BENCHMARKS(VarInt, CVarIntBatch());
+SERIALIZE_BENCHMARKS(String, MakeString());
+SERIALIZE_BENCHMARKS(VectorInt, MakeIntVector());
+SERIALIZE_BENCHMARKS(VectorScript, MakeScriptVector());
+SERIALIZE_BENCHMARKS(Pair, MakePair());
+SERIALIZE_BENCHMARKS(Tuple, MakeTuple());
+SERIALIZE_BENCHMARKS(Map, MakeMap());
+SERIALIZE_BENCHMARKS(Set, MakeSet());
+SERIALIZE_BENCHMARKS(FlatData, CFlatHeader());
+SERIALIZE_BENCHMARKS(Uint256, HashN(0));
+
+// Decoding nested containers into an arena instead of the heap
+typedef vector<unsigned char, arena_allocator<unsigned char> > arena_script;
+
+static void VectorScriptArena_DataStreamRead(benchmark::State& state)
+{
+	vector<vector<unsigned char> > vScripts = MakeScriptVector();
+	unsigned int nSize = GetSerializeSize(vScripts, SER_DISK, PROTOCOL_VERSION);
+	CArena arena(MAX_SIZE);
+
+	CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+	ss << vScripts << vScripts;
+
+	state.SetBytesPerIteration(nSize);
+
+	while (state.KeepRunning())
+	{
+		{
+			CArenaScope scope(arena);
+			vector<arena_script, arena_allocator<arena_script> > vRead;
+			ss >> vRead;
+		}
+		arena.Reset();
+		ss.Rewind(nSize);
+	}
+}
+
+BENCHMARK(VectorScriptArena_DataStreamRead);
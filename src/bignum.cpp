@@ -1,9 +1,109 @@
+#include <algorithm>
 #include <iostream>
 #include <openssl/bn.h>
+#include <boost/thread/tss.hpp>
 #include "bignum.h"
 
 using namespace std;
 
+// Contexts kept per thread between operations. More than this are only live
+// at once with deep nesting; the extra ones are freed when given back
+static const size_t MAX_POOLED_BN_CTX = 8;
+
+static uint64_t nBN_CTXCreated = 0;
+static uint64_t nBN_CTXBorrowed = 0;
+
+// Context of the innermost CBN_CTXScope on this thread, or NULL
+static __thread BN_CTX* pScopeBN_CTX = NULL;
+
+class CBN_CTXPool
+{
+public:
+	std::vector<BN_CTX*> vFree;
+
+	CBN_CTXPool()
+	{
+		// Giving a context back must not allocate
+		vFree.reserve(MAX_POOLED_BN_CTX);
+	}
+
+	~CBN_CTXPool()
+	{
+		for (size_t i = 0; i < vFree.size(); i++)
+			BN_CTX_free(vFree[i]);
+	}
+};
+
+// Each thread's pool is freed when the thread exits. Function-local so that
+// it is usable from other static initializers
+static boost::thread_specific_ptr<CBN_CTXPool>& BN_CTXPool()
+{
+	static boost::thread_specific_ptr<CBN_CTXPool> pool;
+	return pool;
+}
+
+CAutoBN_CTX::CAutoBN_CTX() : pctx(pScopeBN_CTX), fPooled(false)
+{
+	if (pctx != NULL)
+		return;
+
+	CBN_CTXPool* pool = BN_CTXPool().get();
+	if (pool == NULL)
+	{
+		pool = new CBN_CTXPool();
+		BN_CTXPool().reset(pool);
+	}
+
+	if (!pool->vFree.empty())
+	{
+		pctx = pool->vFree.back();
+		pool->vFree.pop_back();
+	}
+	else
+	{
+		pctx = BN_CTX_new();
+		if (pctx == NULL)
+			throw bignum_error("CAutoBN_CTX : BN_CTX_new() returned NULL");
+		__atomic_fetch_add(&nBN_CTXCreated, 1, __ATOMIC_RELAXED);
+	}
+
+	fPooled = true;
+	__atomic_fetch_add(&nBN_CTXBorrowed, 1, __ATOMIC_RELAXED);
+}
+
+CAutoBN_CTX::~CAutoBN_CTX()
+{
+	if (!fPooled || pctx == NULL)
+		return;
+
+	CBN_CTXPool* pool = BN_CTXPool().get();
+	if (pool != NULL && pool->vFree.size() < MAX_POOLED_BN_CTX)
+		pool->vFree.push_back(pctx);
+	else
+		BN_CTX_free(pctx);
+}
+
+uint64_t CAutoBN_CTX::GetCreatedCount()
+{
+	return __atomic_load_n(&nBN_CTXCreated, __ATOMIC_RELAXED);
+}
+
+uint64_t CAutoBN_CTX::GetBorrowedCount()
+{
+	return __atomic_load_n(&nBN_CTXBorrowed, __ATOMIC_RELAXED);
+}
+
+// A nested scope borrows the enclosing scope's context
+CBN_CTXScope::CBN_CTXScope() : pPrev(pScopeBN_CTX)
+{
+	pScopeBN_CTX = ctx;
+}
+
+CBN_CTXScope::~CBN_CTXScope()
+{
+	pScopeBN_CTX = pPrev;
+}
+
 CBigNum::CBigNum()
 {
 	BN_init(this);
@@ -150,10 +250,8 @@ int CBigNum::getint() const
 
 void CBigNum::setint64(int64_t sn)
 {
-	unsigned char pch[sizeof(sn) + 6];
-	unsigned char* p = pch + 4;
-	bool fNegative;
 	uint64_t n;
+	bool fNegative;
 
 	if (sn < (int64_t)0)
 	{
@@ -168,125 +266,119 @@ void CBigNum::setint64(int64_t sn)
 		fNegative = false;
 	}
 
-	bool fLeadingZeroes = true;
-	for (int i = 0; i < 8; i++)
-	{
-		unsigned char c = (n >> 56) & 0xff;
-		n <<= 8;
-		if (fLeadingZeroes)
-		{
-			if (c == 0)
-				continue;
-			if (c & 0x80)
-				*p++ = (fNegative ? 0x80 : 0);
-			else if (fNegative)
-				c |= 0x80;
-			fLeadingZeroes = false;
-		}
-		*p++ = c;
-	}
-	unsigned int nSize = p - (pch + 4);
-	pch[0] = (nSize >> 24) & 0xff;
-	pch[1] = (nSize >> 16) & 0xff;
-	pch[2] = (nSize >> 8) & 0xff;
-	pch[3] = (nSize) & 0xff;
-	BN_mpi2bn(pch, p - pch, this);
+	setuint64(n);
+	BN_set_negative(this, fNegative);
 }
 
 void CBigNum::setuint64(uint64_t n)
 {
-	unsigned char pch[sizeof(n) + 6];
-	unsigned char* p = pch + 4;
-	bool fLeadingZeroes = true;
-	for (int i = 0; i < 8; i++)
+	unsigned char pch[sizeof(n)];
+
+	// Big endian magnitude, which is what BN_bin2bn expects
+	for (int i = sizeof(n) - 1; i >= 0; i--)
 	{
-		unsigned char c = (n >> 56) & 0xff;
-		n <<= 8;
-		if (fLeadingZeroes)
-		{
-			if (c == 0)
-				continue;
-			if (c & 0x80)
-				*p++ = 0;
-			fLeadingZeroes = false;
-		}
-		*p++ = c;
+		pch[i] = n & 0xff;
+		n >>= 8;
 	}
-	unsigned int nSize = p - (pch + 4);
-	pch[0] = (nSize >> 24) & 0xff;
-	pch[1] = (nSize >> 16) & 0xff;
-	pch[2] = (nSize >> 8) & 0xff;
-	pch[3] = (nSize) & 0xff;
-	BN_mpi2bn(pch, p - pch, this);
+
+	if (!BN_bin2bn(pch, sizeof(pch), this))
+		throw bignum_error("CBigNum::setuint64 : BN_bin2bn failed");
 }
 
 void CBigNum::setuint256(uint256 n)
 {
-	unsigned char pch[sizeof(n) + 6];
-	unsigned char* p = pch + 4;
-	bool fLeadingZeroes = true;
-	unsigned char* pbegin = (unsigned char*)&n;
-	unsigned char* psrc = pbegin + sizeof(n);
-	while (psrc != pbegin)
-	{
-		unsigned char c = *(--psrc);
-		if (fLeadingZeroes)
-		{
-			if (c == 0)
-				continue;
-			if (c & 0x80)
-				*p++ = 0;
-			fLeadingZeroes = false;
-		}
-		*p++ = c;
-	}
-	unsigned int nSize = p - (pch + 4);
-	pch[0] = (nSize >> 24) & 0xff;
-	pch[1] = (nSize >> 16) & 0xff;
-	pch[2] = (nSize >> 8) & 0xff;
-	pch[3] = (nSize >> 0) & 0xff;
-	BN_mpi2bn(pch, p - pch, this);
+	unsigned char pch[sizeof(n)];
+	const unsigned char* psrc = (const unsigned char*)&n;
+
+	// uint256 is stored little endian
+	std::reverse_copy(psrc, psrc + sizeof(n), pch);
+
+	if (!BN_bin2bn(pch, sizeof(pch), this))
+		throw bignum_error("CBigNum::setuint256 : BN_bin2bn failed");
 }
 
 uint256 CBigNum::getuint256() const
 {
-	unsigned int nSize = BN_bn2mpi(this, NULL);
-	if (nSize < 4)
-		return 0;
-	std::vector<unsigned char> vch(nSize);
-	BN_bn2mpi(this, &vch[0]);
-	if (vch.size() > 4)
-		vch[4] &= 0x7f;
+	unsigned char pch[sizeof(uint256)];
+	unsigned int nSize = BN_num_bytes(this);
 	uint256 n = 0;
-	for (unsigned int i = 0, j = vch.size()-1; i < sizeof(n) && j >= 4; i++, j--)
-		((unsigned char*)&n)[i] = vch[j];
+	unsigned char* pdest = (unsigned char*)&n;
+
+	if (nSize <= sizeof(pch))
+	{
+		BN_bn2bin(this, pch);
+		std::reverse_copy(pch, pch + nSize, pdest);
+	}
+	else
+	{
+		// Too large: keep the low order bytes of the magnitude
+		std::vector<unsigned char> vch(nSize);
+		BN_bn2bin(this, &vch[0]);
+		std::reverse_copy(vch.end() - sizeof(n), vch.end(), pdest);
+	}
+
 	return n;
 }
 
 void CBigNum::setvch(const std::vector<unsigned char>& vch)
 {
-	std::vector<unsigned char> vch2(vch.size() + 4);
+	// Little endian magnitude, the top bit of the last byte being the sign
+	unsigned char pchBuf[64];
+	std::vector<unsigned char> vchBuf;
+	unsigned char* pch = pchBuf;
 	unsigned int nSize = vch.size();
-	// BIGNUM's byte stream format expects 4 bytes of
-	// big endian size data info at the front
-	vch2[0] = (nSize >> 24) & 0xff;
-	vch2[1] = (nSize >> 16) & 0xff;
-	vch2[2] = (nSize >> 8) & 0xff;
-	vch2[3] = (nSize >> 0) & 0xff;
-	// swap data to big endian
-	reverse_copy(vch.begin(), vch.end(), vch2.begin() + 4);
-	BN_mpi2bn(&vch2[0], vch2.size(), this);
+
+	if (nSize == 0)
+	{
+		BN_zero(this);
+		return;
+	}
+
+	if (nSize > sizeof(pchBuf))
+	{
+		vchBuf.resize(nSize);
+		pch = &vchBuf[0];
+	}
+
+	std::reverse_copy(vch.begin(), vch.end(), pch);
+	bool fNegative = (pch[0] & 0x80) != 0;
+	pch[0] &= 0x7f;
+
+	if (!BN_bin2bn(pch, nSize, this))
+		throw bignum_error("CBigNum::setvch : BN_bin2bn failed");
+
+	BN_set_negative(this, fNegative);
+}
+
+unsigned int CBigNum::getvch(unsigned char* pch, unsigned int nMax) const
+{
+	unsigned int nSize = BN_num_bytes(this);
+
+	if (nSize == 0)
+		return 0;
+
+	if (nSize + 1 > nMax)
+		throw bignum_error("CBigNum::getvch : buffer too small");
+
+	// Big endian magnitude, then turned around in place
+	BN_bn2bin(this, pch);
+	std::reverse(pch, pch + nSize);
+
+	// The sign goes in the top bit of the last byte; if that bit is taken by
+	// the magnitude, an extra byte holds it
+	bool fNegative = BN_is_negative(this);
+	if (pch[nSize - 1] & 0x80)
+		pch[nSize++] = (fNegative ? 0x80 : 0);
+	else if (fNegative)
+		pch[nSize - 1] |= 0x80;
+
+	return nSize;
 }
 
 std::vector<unsigned char> CBigNum::getvch() const
 {
-	unsigned int nSize = BN_bn2mpi(this, NULL);
-	if (nSize <= 4)
-		return std::vector<unsigned char>();
-	std::vector<unsigned char> vch(nSize);
-	BN_bn2mpi(this, &vch[0]);
-	vch.erase(vch.begin(), vch.begin() + 4);
-	reverse(vch.begin(), vch.end());
+	std::vector<unsigned char> vch(BN_num_bytes(this) + 1);
+	vch.resize(getvch(&vch[0], vch.size()));
 	return vch;
 }
 
@@ -24,25 +24,23 @@ public:
 	}
 };
 
+/**
+ * A BN_CTX borrowed for the lifetime of the object.
+ *
+ * Contexts come from a small per-thread pool rather than being created and
+ * freed for every operation; inside a CBN_CTXScope the scope's context is
+ * used directly. Contexts must not be handed to another thread.
+ */
 class CAutoBN_CTX
 {
 protected:
     BN_CTX* pctx;
+    bool fPooled;
     BN_CTX* operator=(BN_CTX* pnew) { return pctx = pnew; }
 
 public:
-    CAutoBN_CTX()
-    {
-        pctx = BN_CTX_new();
-        if (pctx == NULL)
-            throw bignum_error("CAutoBN_CTX : BN_CTX_new() returned NULL");
-    }
-
-    ~CAutoBN_CTX()
-    {
-        if (pctx != NULL)
-            BN_CTX_free(pctx);
-    }
+    CAutoBN_CTX();
+    ~CAutoBN_CTX();
 
     operator BN_CTX*()
     {
@@ -63,6 +61,42 @@ public:
     {
 	    return pctx == NULL;
     }
+
+    // Number of BN_CTX_new calls, and of contexts handed out, in this process
+    static uint64_t GetCreatedCount();
+    static uint64_t GetBorrowedCount();
+
+private:
+    CAutoBN_CTX(const CAutoBN_CTX&);
+    CAutoBN_CTX& operator=(const CAutoBN_CTX&);
+};
+
+/**
+ * Holds one context for a tight loop of CBigNum arithmetic: every
+ * CAutoBN_CTX created on this thread while in scope uses it without
+ * touching the pool. Scopes nest.
+ *
+ *	CBN_CTXScope scope;
+ *	for (...)
+ *		bnWork += bnMax / (bnTarget + 1);
+ */
+class CBN_CTXScope
+{
+public:
+	CBN_CTXScope();
+	~CBN_CTXScope();
+
+	operator BN_CTX*()
+	{
+		return ctx;
+	}
+
+private:
+	CAutoBN_CTX ctx;
+	BN_CTX* pPrev;
+
+	CBN_CTXScope(const CBN_CTXScope&);
+	CBN_CTXScope& operator=(const CBN_CTXScope&);
 };
 
 class CBigNum : public BIGNUM
@@ -97,6 +131,9 @@ public:
 	uint256 getuint256() const;
 	void setvch(const std::vector<unsigned char>& vch);
 	std::vector<unsigned char> getvch() const;
+	// Writes getvch()'s encoding to pch and returns its length; nMax must be
+	// at least BN_num_bytes() + 1
+	unsigned int getvch(unsigned char* pch, unsigned int nMax) const;
 
 	CBigNum& SetCompact(unsigned int nCompact);
 	unsigned int GetCompact() const;
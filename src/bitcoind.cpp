@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <unistd.h>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem.hpp>
@@ -10,27 +11,18 @@
 #include "util.h"
 #include "chainparams.h"
 
-void DetectShutdownThread(boost::thread_group* threadGroup)
-{
-	bool fShutdown = ShutdownRequested();
+// How long the other threads get to stop once shutdown is requested
+static const int64_t SHUTDOWN_JOIN_TIMEOUT_MILLIS = 10000;
 
-	while (!fShutdown)
-	{
-		MilliSleep(200);
-		fShutdown = ShutdownRequested();
-	}
-
-	if (threadGroup)
-	{
-		threadGroup->interrupt_all();
-		threadGroup->join_all();
-	}
+static void StopThreads(boost::thread_group* threadGroup)
+{
+	threadGroup->interrupt_all();
+	threadGroup->join_all();
 }
 
 bool AppInit(int argc, char* argv[])
 {
-	boost::thread_group threadGroup;
-	boost::thread *detectShutdownThread = 0;
+	boost::thread_group* threadGroup = NULL;
 	bool fRet = false;
 
 	ParseParameters(argc, argv);
@@ -45,7 +37,7 @@ bool AppInit(int argc, char* argv[])
 	{
 	cout << __func__ << ": " << __LINE__ << endl;
 		fprintf(stderr, "%s: Error: Specified data directory "
-			"\"%s\" does not exists.\n", __func__, mapArgs["-datadir"].c_str());
+			"\"%s\" does not exists.\n", __func__, GetArg(SETTING_DATADIR).c_str());
 		return false;
 	}
 
@@ -79,40 +71,34 @@ bool AppInit(int argc, char* argv[])
 	}
 
 	cout << __func__ << ": " << __LINE__ << endl;
-	SoftSetBoolArg("-server", true);
-
-	cout << __func__ << ": " << __LINE__ << endl;
-	detectShutdownThread = new boost::thread(
-		boost::bind(&DetectShutdownThread, &threadGroup));
-
-	cout << __func__ << ": " << __LINE__ << endl;
-	fRet = AppInit2(threadGroup);
+	threadGroup = new boost::thread_group();
+	fRet = AppInit2(*threadGroup);
 	cout << __func__ << ": " << __LINE__ << endl;
 
 	if (!fRet)
 	{
 	cout << __func__ << ": " << __LINE__ << endl;
-		if (detectShutdownThread)
-		{
-	cout << __func__ << ": " << __LINE__ << endl;
-			detectShutdownThread->interrupt();
-		}
-
-	cout << __func__ << ": " << __LINE__ << endl;
-		threadGroup.interrupt_all();
+		StartShutdown();
 	}
+
+	// After the phases AppInit2() registered, so that they run first
+	RegisterShutdownPhase("threads", SHUTDOWN_JOIN_TIMEOUT_MILLIS,
+		boost::bind(&StopThreads, threadGroup));
+
 	cout << __func__ << ": " << __LINE__ << endl;
+	WaitForShutdown();
 
-	if (detectShutdownThread)
-	{
 	cout << __func__ << ": " << __LINE__ << endl;
-		detectShutdownThread->join();
-		delete detectShutdownThread;
-		detectShutdownThread = NULL;
+	if (!Shutdown())
+	{
+		// An abandoned phase may still be using threadGroup or anything
+		// else it references: keep it all and exit without running the
+		// static destructors
+		fprintf(stderr, "%s: Shutdown did not finish, exiting anyway.\n", __func__);
+		_exit(1);
 	}
-	cout << __func__ << ": " << __LINE__ << endl;
 
-	Shutdown();
+	delete threadGroup;
 	cout << __func__ << ": " << __LINE__ << endl;
 
 	return fRet;
@@ -0,0 +1,340 @@
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <new>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bufferedwriter.h"
+
+using namespace std;
+
+// O_DIRECT transfers must be aligned to the logical block size in memory,
+// file offset and length; a page covers every device we care about
+static const size_t DIRECT_ALIGN = 4096;
+
+// writev() accepts at most IOV_MAX buffers per call
+static const size_t MAX_IOVECS = 1024;
+
+CBufferedWriter::CBufferedWriter(const std::string& strPath, Durability durabilityIn, size_t nBufSizeIn, int nTypeIn, int nVersionIn) :
+	fd(-1), durability(durabilityIn), pchBuf(NULL), nBufSize(0), nBufPos(0), nPos(0),
+	state(0), exceptmask(std::ios::badbit | std::ios::failbit), nType(nTypeIn), nVersion(nVersionIn)
+{
+	int nFlags = O_WRONLY | O_CREAT;
+
+	if (durability == DURABILITY_DIRECT)
+	{
+		nFlags |= O_DIRECT;
+	}
+	else
+	{
+		nFlags |= O_APPEND;
+	}
+
+	fd = open(strPath.c_str(), nFlags, 0644);
+
+	if (fd == -1 && durability == DURABILITY_DIRECT && errno == EINVAL)
+	{
+		// Filesystem without O_DIRECT support (e.g. tmpfs)
+		durability = DURABILITY_FDATASYNC;
+		fd = open(strPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+	}
+
+	if (fd == -1)
+	{
+		setstate(std::ios::failbit, "CBufferedWriter : cannot open file");
+		return;
+	}
+
+	struct stat st;
+
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		fd = -1;
+		setstate(std::ios::failbit, "CBufferedWriter : cannot stat file");
+		return;
+	}
+
+	nPos = st.st_size;
+
+	if (durability == DURABILITY_DIRECT)
+	{
+		// No O_APPEND here, so position at the end ourselves
+		if (lseek(fd, nPos, SEEK_SET) == (off_t)-1)
+		{
+			close(fd);
+			fd = -1;
+			setstate(std::ios::failbit, "CBufferedWriter : cannot seek to end of file");
+			return;
+		}
+
+		if (nPos % DIRECT_ALIGN != 0)
+		{
+			// Appending at an unaligned offset is not possible with O_DIRECT
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+			durability = DURABILITY_FDATASYNC;
+		}
+	}
+
+	if (durability == DURABILITY_DIRECT)
+	{
+		nBufSizeIn = max((nBufSizeIn + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN, DIRECT_ALIGN);
+		void* p = NULL;
+
+		if (posix_memalign(&p, DIRECT_ALIGN, nBufSizeIn) == 0)
+		{
+			pchBuf = (char*)p;
+		}
+	}
+	else
+	{
+		nBufSizeIn = max(nBufSizeIn, (size_t)1);
+		pchBuf = (char*)malloc(nBufSizeIn);
+	}
+
+	if (pchBuf == NULL)
+	{
+		// The destructor does not run for a constructor that throws
+		close(fd);
+		fd = -1;
+		throw std::bad_alloc();
+	}
+
+	nBufSize = nBufSizeIn;
+}
+
+CBufferedWriter::~CBufferedWriter()
+{
+	try
+	{
+		Close();
+	}
+	catch (std::ios_base::failure&)
+	{
+	}
+
+	free(pchBuf);
+}
+
+bool CBufferedWriter::WriteAll(const char* pch, size_t nSize)
+{
+	while (nSize > 0)
+	{
+		ssize_t nWritten = ::write(fd, pch, nSize);
+
+		if (nWritten < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			return false;
+		}
+
+		pch += nWritten;
+		nSize -= nWritten;
+	}
+
+	return true;
+}
+
+bool CBufferedWriter::FlushBuffer()
+{
+	size_t nWrite = nBufPos;
+
+	if (durability == DURABILITY_DIRECT)
+	{
+		// Only whole blocks; the tail waits for more data or Close()
+		nWrite -= nWrite % DIRECT_ALIGN;
+	}
+
+	if (nWrite == 0)
+	{
+		return true;
+	}
+
+	if (!WriteAll(pchBuf, nWrite))
+	{
+		setstate(std::ios::failbit, "CBufferedWriter::Flush : write failed");
+		return false;
+	}
+
+	nBufPos -= nWrite;
+
+	if (nBufPos != 0)
+	{
+		memmove(pchBuf, pchBuf + nWrite, nBufPos);
+	}
+
+	return true;
+}
+
+void CBufferedWriter::WriteSlow(const char* pch, size_t nSize)
+{
+	if (fd == -1)
+	{
+		setstate(std::ios::failbit, "CBufferedWriter::write : file is not open");
+		return;
+	}
+
+	while (nSize > 0)
+	{
+		if (nBufPos == nBufSize && !FlushBuffer())
+		{
+			return;
+		}
+
+		if (nBufPos == 0 && nSize >= nBufSize && durability != DURABILITY_DIRECT)
+		{
+			// Nothing staged and more than a buffer's worth: skip the copy
+			if (!WriteAll(pch, nSize))
+			{
+				setstate(std::ios::failbit, "CBufferedWriter::write : write failed");
+				return;
+			}
+
+			nPos += nSize;
+			return;
+		}
+
+		size_t nNow = min(nSize, nBufSize - nBufPos);
+		memcpy(pchBuf + nBufPos, pch, nNow);
+		nBufPos += nNow;
+		nPos += nNow;
+		pch += nNow;
+		nSize -= nNow;
+	}
+}
+
+void CBufferedWriter::WriteGather(struct iovec* iov, size_t nCount)
+{
+	if (fd == -1)
+	{
+		setstate(std::ios::failbit, "CBufferedWriter::WriteRecords : file is not open");
+		return;
+	}
+
+	if (durability == DURABILITY_DIRECT)
+	{
+		// The records are not aligned; they have to go through the staging buffer
+		for (size_t i = 0; i < nCount; i++)
+		{
+			write((const char*)iov[i].iov_base, iov[i].iov_len);
+		}
+
+		return;
+	}
+
+	// Keep file order: whatever is staged goes out first
+	if (!FlushBuffer())
+	{
+		return;
+	}
+
+	while (nCount > 0)
+	{
+		size_t nBatch = min(nCount, MAX_IOVECS);
+		ssize_t nWritten = writev(fd, iov, nBatch);
+
+		if (nWritten < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			setstate(std::ios::failbit, "CBufferedWriter::WriteRecords : writev failed");
+			return;
+		}
+
+		nPos += nWritten;
+
+		// Skip what was written, resuming a partially written buffer
+		while (nCount > 0 && (size_t)nWritten >= iov->iov_len)
+		{
+			nWritten -= iov->iov_len;
+			iov++;
+			nCount--;
+		}
+
+		if (nWritten > 0)
+		{
+			iov->iov_base = (char*)iov->iov_base + nWritten;
+			iov->iov_len -= nWritten;
+		}
+	}
+}
+
+bool CBufferedWriter::Flush()
+{
+	if (fd == -1)
+	{
+		return false;
+	}
+
+	if (!FlushBuffer())
+	{
+		return false;
+	}
+
+	if (durability != DURABILITY_NONE && fdatasync(fd) != 0)
+	{
+		setstate(std::ios::failbit, "CBufferedWriter::Flush : fdatasync failed");
+		return false;
+	}
+
+	return true;
+}
+
+bool CBufferedWriter::Close()
+{
+	if (fd == -1)
+	{
+		return true;
+	}
+
+	bool fRet = FlushBuffer();
+
+	if (fRet && nBufPos != 0)
+	{
+		// Unaligned tail of an O_DIRECT file: write it through the page cache
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+
+		if (WriteAll(pchBuf, nBufPos))
+		{
+			nBufPos = 0;
+		}
+		else
+		{
+			fRet = false;
+		}
+	}
+
+	if (fRet && durability != DURABILITY_NONE && fdatasync(fd) != 0)
+	{
+		fRet = false;
+	}
+
+	if (close(fd) != 0)
+	{
+		fRet = false;
+	}
+
+	fd = -1;
+
+	// With no room left, every later write() takes the slow path and fails
+	free(pchBuf);
+	pchBuf = NULL;
+	nBufSize = 0;
+	nBufPos = 0;
+
+	if (!fRet)
+	{
+		setstate(std::ios::failbit, "CBufferedWriter::Close : write failed");
+	}
+
+	return fRet;
+}
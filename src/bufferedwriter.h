@@ -0,0 +1,154 @@
+#ifndef BITCOIN_BUFFEREDWRITER_H
+#define BITCOIN_BUFFEREDWRITER_H
+
+#include <ios>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <sys/uio.h>
+#include <vector>
+
+#include "serialize.h"
+
+/** Append-only file writer with a large user-space staging buffer.
+ *
+ * Serialized fields are gathered in memory and reach the file in large
+ * write() calls, only when the buffer fills up or on an explicit Flush().
+ * What Flush() guarantees depends on the durability policy:
+ *
+ *   DURABILITY_NONE      - data is handed to the kernel
+ *   DURABILITY_FDATASYNC - data is on stable storage (fdatasync)
+ *   DURABILITY_DIRECT    - data bypasses the page cache (O_DIRECT with an
+ *                          aligned buffer); a tail shorter than a block
+ *                          stays staged until Close(). Falls back to
+ *                          DURABILITY_FDATASYNC if the file's current size
+ *                          is not block aligned.
+ *
+ * Errors are reported through setstate() like CAutoFile.
+ */
+class CBufferedWriter
+{
+public:
+    enum Durability
+    {
+        DURABILITY_NONE,
+        DURABILITY_FDATASYNC,
+        DURABILITY_DIRECT,
+    };
+
+private:
+    int fd;
+    Durability durability;
+    char* pchBuf;      // staging buffer, block aligned for O_DIRECT
+    size_t nBufSize;
+    size_t nBufPos;    // bytes staged in pchBuf
+    uint64_t nPos;     // file offset of the end of the staged data
+
+    short state;
+    short exceptmask;
+
+    CBufferedWriter(const CBufferedWriter&);
+    CBufferedWriter& operator=(const CBufferedWriter&);
+
+    bool WriteAll(const char* pch, size_t nSize);
+    bool FlushBuffer();
+    void WriteSlow(const char* pch, size_t nSize);
+    void WriteGather(struct iovec* iov, size_t nCount);
+
+protected:
+    void setstate(short bits, const char* psz)
+    {
+        state |= bits;
+        if (state & exceptmask)
+            throw std::ios_base::failure(psz);
+    }
+
+public:
+    int nType;
+    int nVersion;
+
+    // Opens (creating if needed) strPath for appending
+    CBufferedWriter(const std::string& strPath, Durability durabilityIn, size_t nBufSizeIn, int nTypeIn, int nVersionIn);
+    ~CBufferedWriter();
+
+    bool IsOpen() const             { return fd != -1; }
+    Durability GetDurability() const { return durability; }
+
+    // File offset at which the next write() will land
+    uint64_t GetPos() const         { return nPos; }
+
+    // Write out everything staged and apply the durability policy
+    bool Flush();
+
+    // Flush, write any O_DIRECT tail, sync and close the file
+    bool Close();
+
+
+    //
+    // Stream subset
+    //
+    bool fail() const            { return state & (std::ios::badbit | std::ios::failbit); }
+    bool good() const            { return state == 0; }
+    void clear(short n = 0)      { state = n; }
+    short exceptions()           { return exceptmask; }
+    short exceptions(short mask) { short prev = exceptmask; exceptmask = mask; setstate(0, "CBufferedWriter"); return prev; }
+
+    void SetType(int n)          { nType = n; }
+    int GetType()                { return nType; }
+    void SetVersion(int n)       { nVersion = n; }
+    int GetVersion()             { return nVersion; }
+
+    // The buffer has no room while the file is not open, so the fast path
+    // below is never taken then
+    CBufferedWriter& write(const char* pch, size_t nSize)
+    {
+        if (nSize <= nBufSize - nBufPos)
+        {
+            memcpy(pchBuf + nBufPos, pch, nSize);
+            nBufPos += nSize;
+            nPos += nSize;
+        }
+        else
+            WriteSlow(pch, nSize);
+        return (*this);
+    }
+
+    // Append many already serialized records, using one writev() per batch
+    // instead of copying them through the staging buffer
+    template<typename Container>
+    void WriteRecords(const std::vector<Container>& vRecords)
+    {
+        std::vector<struct iovec> iov;
+        iov.reserve(vRecords.size());
+        for (size_t i = 0; i < vRecords.size(); i++)
+        {
+            if (vRecords[i].empty())
+                continue;
+            struct iovec v;
+            v.iov_base = (void*)&vRecords[i][0];
+            v.iov_len = vRecords[i].size() * sizeof(vRecords[i][0]);
+            iov.push_back(v);
+        }
+        if (!iov.empty())
+            WriteGather(&iov[0], iov.size());
+    }
+
+    template<typename T>
+    unsigned int GetSerializeSize(const T& obj)
+    {
+        // Tells the size of the object if serialized to this stream
+        return ::GetSerializeSize(obj, nType, nVersion);
+    }
+
+    template<typename T>
+    CBufferedWriter& operator<<(const T& obj)
+    {
+        // Serialize to this stream
+        if (fd == -1)
+            throw std::ios_base::failure("CBufferedWriter::operator<< : file is not open");
+        ::Serialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
+#endif // BITCOIN_BUFFEREDWRITER_H
@@ -2,6 +2,22 @@
 #include "chainparams.h"
 #include "util.h"
 
+// Chain constants. The hex literals are parsed at compile time, so these sit
+// in .rodata and need no static initialization
+static constexpr uint256 hashGenesisMain = "000000000019d6689c085ae165831e934ff763ae46a2a6c172b3f1b60a8ce26f"_uint256;
+static constexpr uint256 hashGenesisTestNet = "000000000933ea01ad0ee984209779baaec3ced90fa3f408719526f8d77f4943"_uint256;
+static constexpr uint256 hashGenesisRegTest = "0f9188f13cb7b2c71f2a335e3a4fc328bf5beb436012afca590b1a11466e2206"_uint256;
+
+// ~uint256(0) >> 32
+static constexpr uint256 nProofOfWorkLimitMain = "00000000ffffffffffffffffffffffffffffffffffffffffffffffffffffffff"_uint256;
+// ~uint256(0) >> 1
+static constexpr uint256 nProofOfWorkLimitRegTest = "7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff"_uint256;
+
+// Every genesis block has to meet its own network's limit
+static_assert(hashGenesisMain <= nProofOfWorkLimitMain, "main genesis hash above the proof-of-work limit");
+static_assert(hashGenesisTestNet <= nProofOfWorkLimitMain, "testnet genesis hash above the proof-of-work limit");
+static_assert(hashGenesisRegTest <= nProofOfWorkLimitRegTest, "regtest genesis hash above the proof-of-work limit");
+
 class CMainParams : public CChainParams
 {
 public:
@@ -11,6 +27,8 @@ public:
 		pchMessageStart.bytes[1] = 0xbe;
 		pchMessageStart.bytes[2] = 0xb4;
 		pchMessageStart.bytes[3] = 0xd9;
+		hashGenesisBlock = hashGenesisMain;
+		nProofOfWorkLimit = nProofOfWorkLimitMain;
 	}
 
 	Network NetworkID() const
@@ -32,6 +50,8 @@ public:
 		pchMessageStart.bytes[1] = 0x11;
 		pchMessageStart.bytes[2] = 0x09;
 		pchMessageStart.bytes[3] = 0x07;
+		hashGenesisBlock = hashGenesisTestNet;
+		nProofOfWorkLimit = nProofOfWorkLimitMain;
 	}
 
 	virtual Network NetworkID() const
@@ -51,6 +71,8 @@ public:
 		pchMessageStart.bytes[1] = 0xbf;
 		pchMessageStart.bytes[2] = 0xb5;
 		pchMessageStart.bytes[3] = 0xda;
+		hashGenesisBlock = hashGenesisRegTest;
+		nProofOfWorkLimit = nProofOfWorkLimitRegTest;
 	}
 
 	virtual Network NetworkID() const
@@ -89,8 +111,8 @@ void SelectParams(CChainParams::Network network)
 
 bool SelectParamsFromCommandLine()
 {
-	bool regTest = GetBoolArg("-regtest", false);
-	bool testNet = GetBoolArg("-testnet", false);
+	bool regTest = GetBoolArg(SETTING_REGTEST);
+	bool testNet = GetBoolArg(SETTING_TESTNET);
 
 	if (regTest && testNet)
 	{
@@ -1,7 +1,9 @@
 #ifndef BITCOIN_CHAIN_PARAMS_H
 #define BITCOIN_CHAIN_PARAMS_H
 
-#define MESSAGE_START_SIZE
+#include "uint256.h"
+
+#define MESSAGE_START_SIZE 4
 struct MessageStartChars
 {
 	unsigned char bytes[MESSAGE_START_SIZE];
@@ -23,6 +25,17 @@ public:
 		return pchMessageStart;
 	}
 
+	const uint256& HashGenesisBlock() const
+	{
+		return hashGenesisBlock;
+	}
+
+	// Highest allowed proof-of-work target, i.e. the minimum difficulty
+	const uint256& ProofOfWorkLimit() const
+	{
+		return nProofOfWorkLimit;
+	}
+
 	virtual Network NetworkID() const
 	{
 		while (1) ;
@@ -34,6 +47,8 @@ protected:
 	}
 
 	MessageStartChars pchMessageStart;
+	uint256 hashGenesisBlock;
+	uint256 nProofOfWorkLimit;
 };
 
 const CChainParams& Params();
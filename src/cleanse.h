@@ -0,0 +1,102 @@
+#ifndef BITCOIN_CLEANSE_H
+#define BITCOIN_CLEANSE_H
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Overwrite len bytes at ptr with zeroes, in a way the compiler cannot drop
+ * as a dead store even when the memory is freed right after.
+ *
+ * The zeroing itself is a plain memset(), so it gets libc's wide vector
+ * stores (and non-temporal ones for buffers larger than the cache); the
+ * empty asm statement that takes ptr and clobbers memory makes the compiler
+ * assume the zeroes are read, which is what explicit_bzero() does.
+ */
+inline void memory_cleanse(void* ptr, size_t len)
+{
+	memset(ptr, 0, len);
+	__asm__ __volatile__("" : : "r"(ptr) : "memory");
+}
+
+// Below this, checking which pages were written costs more than wiping
+static const size_t CLEANSE_PAGEMAP_THRESHOLD = 256 * 1024;
+
+/**
+ * memory_cleanse() for large buffers that are often only partly used, such
+ * as the spare capacity of a serialization buffer: whole pages that the
+ * process provably never wrote are left alone, which also avoids faulting
+ * them in just to zero them.
+ *
+ * A page counts as never written only if /proc/self/pagemap shows it
+ * neither present nor swapped out; such a page holds nothing but the zeroes
+ * it will read as. Anything in doubt is wiped.
+ */
+inline void memory_cleanse_touched(void* ptr, size_t len)
+{
+	static const long nPageSize = sysconf(_SC_PAGESIZE);
+	static const int fdPagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+
+	if (len < CLEANSE_PAGEMAP_THRESHOLD || fdPagemap == -1 || nPageSize <= 0)
+	{
+		memory_cleanse(ptr, len);
+		return;
+	}
+
+	const uintptr_t nPage = nPageSize;
+	uintptr_t nStart = (uintptr_t)ptr;
+	uintptr_t nEnd = nStart + len;
+	uintptr_t nFirst = (nStart + nPage - 1) & ~(nPage - 1);
+	uintptr_t nLast = nEnd & ~(nPage - 1);
+
+	// Partial pages at either end are shared with other allocations
+	memory_cleanse(ptr, nFirst - nStart);
+	memory_cleanse((void*)nLast, nEnd - nLast);
+
+	// One pagemap entry per page: bit 63 present, bit 62 swapped
+	const uint64_t PAGE_IN_USE = (uint64_t)3 << 62;
+	uint64_t vEntry[512];
+
+	for (uintptr_t nChunk = nFirst; nChunk < nLast; )
+	{
+		size_t nPages = (nLast - nChunk) / nPage;
+		if (nPages > sizeof(vEntry) / sizeof(vEntry[0]))
+		{
+			nPages = sizeof(vEntry) / sizeof(vEntry[0]);
+		}
+
+		ssize_t nRead = pread(fdPagemap, vEntry, nPages * sizeof(uint64_t), (off_t)(nChunk / nPage * sizeof(uint64_t)));
+		if (nRead != (ssize_t)(nPages * sizeof(uint64_t)))
+		{
+			memory_cleanse((void*)nChunk, nPages * nPage);
+			nChunk += nPages * nPage;
+			continue;
+		}
+
+		// Wipe runs of pages in use with one call each
+		for (size_t i = 0; i < nPages; )
+		{
+			if (!(vEntry[i] & PAGE_IN_USE))
+			{
+				i++;
+				continue;
+			}
+
+			size_t j = i + 1;
+			while (j < nPages && (vEntry[j] & PAGE_IN_USE))
+			{
+				j++;
+			}
+
+			memory_cleanse((void*)(nChunk + i * nPage), (j - i) * nPage);
+			i = j;
+		}
+
+		nChunk += nPages * nPage;
+	}
+}
+
+#endif // BITCOIN_CLEANSE_H
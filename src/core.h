@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 
+#include <boost/static_assert.hpp>
+
+#include "serialize.h"
 #include "uint256.h"
 
 class CTransaction;
@@ -24,6 +27,11 @@ public:
 		n    = nIn;
 	}
 
+	IMPLEMENT_SERIALIZE
+	(
+		READWRITE(FLATDATA(*this));
+	)
+
 	void SetNull()
 	{
 		hash = 0;
@@ -67,6 +75,10 @@ public:
 
 };
 
+// Serialized as its raw 36 bytes, so vectors of outpoints can be copied in bulk
+BOOST_STATIC_ASSERT(sizeof(COutPoint) == 36);
+template<> struct is_flat_serializable<COutPoint> : public boost::true_type { };
+
 class CInPoint
 {
 public:
@@ -0,0 +1,25 @@
+#include <openssl/rand.h>
+#include <stdexcept>
+
+#include "hashmap.h"
+
+using namespace std;
+
+static CHashSalt MakeHashSalt()
+{
+	CHashSalt salt;
+
+	if (RAND_bytes((unsigned char*)&salt, sizeof(salt)) != 1)
+	{
+		throw std::runtime_error("GetHashSalt : RAND_bytes failed");
+	}
+
+	return salt;
+}
+
+const CHashSalt& GetHashSalt()
+{
+	// Initialized once, thread-safely, on first use
+	static const CHashSalt salt = MakeHashSalt();
+	return salt;
+}
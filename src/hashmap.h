@@ -0,0 +1,589 @@
+#ifndef BITCOIN_HASHMAP_H
+#define BITCOIN_HASHMAP_H
+
+#include <algorithm>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "core.h"
+#include "serialize.h"
+#include "uint256.h"
+#include "version.h"
+
+/** Per-process random salt for the hashers below, drawn on first use. */
+struct CHashSalt
+{
+	uint64_t k0, k1, k2, k3;
+};
+
+const CHashSalt& GetHashSalt();
+
+// Multiply and fold: cheap, and with a secret operand the result cannot be
+// steered by choosing the other one
+static inline uint64_t HashMix(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 r = (unsigned __int128)a * b;
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+	uint64_t lo = a * b;
+	uint64_t hi = (a >> 32) * (b >> 32) + (((a >> 32) * (uint32_t)b + (uint32_t)a * (b >> 32)) >> 32);
+	return lo ^ hi;
+#endif
+}
+
+/**
+ * Hashers for keys that are already uniformly distributed hashes. The bits
+ * are used as they are, keyed with the process salt, so that peers cannot
+ * grind keys that pile into one bucket.
+ */
+class CSaltedUint256Hasher
+{
+public:
+	CSaltedUint256Hasher() : salt(GetHashSalt()) {}
+
+	size_t operator()(const uint256& hash) const
+	{
+		uint64_t n[4];
+		memcpy(n, hash.begin(), sizeof(n));
+		return HashMix(n[0] ^ salt.k0, n[1] ^ salt.k1) ^ HashMix(n[2] ^ salt.k2, n[3] ^ salt.k3);
+	}
+
+private:
+	CHashSalt salt;
+};
+
+class CSaltedOutPointHasher
+{
+public:
+	CSaltedOutPointHasher() : salt(GetHashSalt()) {}
+
+	size_t operator()(const COutPoint& outpoint) const
+	{
+		uint64_t n[4];
+		memcpy(n, outpoint.hash.begin(), sizeof(n));
+		return HashMix(n[0] ^ salt.k0, n[1] ^ salt.k1) ^ HashMix(n[2] ^ salt.k2, n[3] ^ salt.k3 ^ outpoint.n);
+	}
+
+private:
+	CHashSalt salt;
+};
+
+template<typename K> struct CSaltedHasher;
+template<> struct CSaltedHasher<uint256> : public CSaltedUint256Hasher {};
+template<> struct CSaltedHasher<COutPoint> : public CSaltedOutPointHasher {};
+
+// Control byte of a slot: the low 7 bits of the hash if full, else one of these
+enum
+{
+	HASH_CTRL_EMPTY = -128,
+	HASH_CTRL_DELETED = -2,
+};
+
+/**
+ * Sixteen control bytes matched at once. Bit i of a mask is set when slot i
+ * of the group matches.
+ */
+class CHashGroup
+{
+public:
+	enum { WIDTH = 16 };
+
+#ifdef __SSE2__
+	explicit CHashGroup(const int8_t* pctrl) : ctrl(_mm_loadu_si128((const __m128i*)pctrl)) {}
+
+	uint32_t Match(int8_t h2) const
+	{
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl));
+	}
+
+	// Empty or deleted: the only control bytes with the top bit set
+	uint32_t MatchFree() const
+	{
+		return _mm_movemask_epi8(ctrl);
+	}
+
+private:
+	__m128i ctrl;
+#else
+	explicit CHashGroup(const int8_t* pctrlIn) : pctrl(pctrlIn) {}
+
+	uint32_t Match(int8_t h2) const
+	{
+		uint32_t nMask = 0;
+		for (int i = 0; i < WIDTH; i++)
+			nMask |= (uint32_t)(pctrl[i] == h2) << i;
+		return nMask;
+	}
+
+	uint32_t MatchFree() const
+	{
+		uint32_t nMask = 0;
+		for (int i = 0; i < WIDTH; i++)
+			nMask |= (uint32_t)(pctrl[i] < 0) << i;
+		return nMask;
+	}
+
+private:
+	const int8_t* pctrl;
+#endif
+
+public:
+	uint32_t MatchEmpty() const
+	{
+		return Match(HASH_CTRL_EMPTY);
+	}
+};
+
+template<typename T>
+struct CHashIdentityKey
+{
+	typedef T key_type;
+	static const T& Get(const T& v) { return v; }
+};
+
+template<typename P>
+struct CHashFirstKey
+{
+	typedef typename P::first_type key_type;
+	static const key_type& Get(const P& v) { return v.first; }
+};
+
+/**
+ * Open addressing hash table in the style of Abseil's Swiss tables: a
+ * control byte per slot holds 7 bits of the hash, and probing looks at 16
+ * control bytes per step with one SSE2 compare. Keys are compared only on a
+ * control byte match, so a lookup usually touches one cache line of control
+ * bytes and one slot. The load factor is kept at or below 7/8.
+ *
+ * Iteration order depends on the process salt. Inserting may move every
+ * element, invalidating iterators and references; erasing invalidates only
+ * the erased element.
+ */
+template<typename Slot, typename KeyOf, typename Hasher>
+class CHashTable
+{
+public:
+	typedef typename KeyOf::key_type key_type;
+	typedef Slot value_type;
+	typedef size_t size_type;
+
+	template<typename V, typename Table>
+	class iterator_base
+	{
+	public:
+		iterator_base() : table(NULL), i(0) {}
+		iterator_base(Table* tableIn, size_t iIn) : table(tableIn), i(iIn) {}
+		// iterator to const_iterator
+		template<typename V2, typename Table2>
+		iterator_base(const iterator_base<V2, Table2>& it) : table(it.table), i(it.i) {}
+
+		V& operator*() const { return table->pslots[i]; }
+		V* operator->() const { return &table->pslots[i]; }
+
+		iterator_base& operator++()
+		{
+			i = table->NextFull(i + 1);
+			return *this;
+		}
+
+		iterator_base operator++(int)
+		{
+			iterator_base it = *this;
+			++*this;
+			return it;
+		}
+
+		bool operator==(const iterator_base& it) const { return i == it.i; }
+		bool operator!=(const iterator_base& it) const { return i != it.i; }
+
+	private:
+		template<typename V2, typename Table2> friend class iterator_base;
+		friend class CHashTable;
+
+		Table* table;
+		size_t i;
+	};
+
+	typedef iterator_base<Slot, CHashTable> iterator;
+	typedef iterator_base<const Slot, const CHashTable> const_iterator;
+
+	explicit CHashTable(const Hasher& hasherIn = Hasher()) :
+		hasher(hasherIn), pctrl(NULL), pslots(NULL), nCapacity(0), nSize(0), nGrowthLeft(0)
+	{
+	}
+
+	CHashTable(const CHashTable& table) :
+		hasher(table.hasher), pctrl(NULL), pslots(NULL), nCapacity(0), nSize(0), nGrowthLeft(0)
+	{
+		reserve(table.size());
+		for (const_iterator it = table.begin(); it != table.end(); ++it)
+			InsertNew(*it);
+	}
+
+	~CHashTable()
+	{
+		Destroy();
+	}
+
+	CHashTable& operator=(const CHashTable& table)
+	{
+		CHashTable tmp(table);
+		swap(tmp);
+		return *this;
+	}
+
+	void swap(CHashTable& table)
+	{
+		std::swap(hasher, table.hasher);
+		std::swap(pctrl, table.pctrl);
+		std::swap(pslots, table.pslots);
+		std::swap(nCapacity, table.nCapacity);
+		std::swap(nSize, table.nSize);
+		std::swap(nGrowthLeft, table.nGrowthLeft);
+	}
+
+	iterator begin() { return iterator(this, NextFull(0)); }
+	iterator end() { return iterator(this, nCapacity); }
+	const_iterator begin() const { return const_iterator(this, NextFull(0)); }
+	const_iterator end() const { return const_iterator(this, nCapacity); }
+
+	size_t size() const { return nSize; }
+	bool empty() const { return nSize == 0; }
+	size_t capacity() const { return nCapacity; }
+
+	// Bytes of control bytes and slots, for memory accounting
+	size_t DynamicMemoryUsage() const
+	{
+		return nCapacity * (1 + sizeof(Slot));
+	}
+
+	void clear()
+	{
+		Destroy();
+		pctrl = NULL;
+		pslots = NULL;
+		nCapacity = 0;
+		nSize = 0;
+		nGrowthLeft = 0;
+	}
+
+	// Make room for n elements without further rehashing
+	void reserve(size_t n)
+	{
+		if (n <= nSize + nGrowthLeft)
+			return;
+
+		size_t nNewCapacity = CHashGroup::WIDTH;
+		while (MaxLoad(nNewCapacity) < n)
+			nNewCapacity *= 2;
+
+		Rehash(nNewCapacity);
+	}
+
+	iterator find(const key_type& key)
+	{
+		return iterator(this, Find(key));
+	}
+
+	const_iterator find(const key_type& key) const
+	{
+		return const_iterator(this, Find(key));
+	}
+
+	size_t count(const key_type& key) const
+	{
+		return Find(key) != nCapacity;
+	}
+
+	std::pair<iterator, bool> insert(const Slot& v)
+	{
+		size_t i = Find(KeyOf::Get(v));
+
+		if (i != nCapacity)
+			return std::make_pair(iterator(this, i), false);
+
+		return std::make_pair(iterator(this, InsertNew(v)), true);
+	}
+
+	size_t erase(const key_type& key)
+	{
+		size_t i = Find(key);
+
+		if (i == nCapacity)
+			return 0;
+
+		EraseAt(i);
+		return 1;
+	}
+
+	void erase(const_iterator it)
+	{
+		EraseAt(it.i);
+	}
+
+protected:
+	Hasher hasher;
+	int8_t* pctrl;
+	Slot* pslots;
+	size_t nCapacity;   // zero, or a power of two and a multiple of the group width
+	size_t nSize;
+	size_t nGrowthLeft; // empty slots that may still be filled before a rehash
+
+	static size_t MaxLoad(size_t nCap)
+	{
+		return nCap - nCap / 8;
+	}
+
+	size_t NextFull(size_t i) const
+	{
+		while (i < nCapacity && pctrl[i] < 0)
+			i++;
+		return i;
+	}
+
+	// Index of key's slot, or nCapacity if absent
+	size_t Find(const key_type& key) const
+	{
+		if (nSize == 0)
+			return nCapacity;
+
+		size_t nHash = hasher(key);
+		int8_t h2 = nHash & 0x7f;
+		size_t nGroupMask = nCapacity / CHashGroup::WIDTH - 1;
+		size_t g = (nHash >> 7) & nGroupMask;
+
+		// Triangular steps visit every group when the count is a power of two
+		for (size_t nStep = 1; ; nStep++)
+		{
+			CHashGroup group(pctrl + g * CHashGroup::WIDTH);
+
+			for (uint32_t nMask = group.Match(h2); nMask != 0; nMask &= nMask - 1)
+			{
+				size_t i = g * CHashGroup::WIDTH + __builtin_ctz(nMask);
+				if (KeyOf::Get(pslots[i]) == key)
+					return i;
+			}
+
+			// The key would have been placed at or before the first empty slot
+			if (group.MatchEmpty() != 0)
+				return nCapacity;
+
+			g = (g + nStep) & nGroupMask;
+		}
+	}
+
+	// First empty or deleted slot on nHash's probe sequence
+	size_t FindFree(size_t nHash) const
+	{
+		size_t nGroupMask = nCapacity / CHashGroup::WIDTH - 1;
+		size_t g = (nHash >> 7) & nGroupMask;
+
+		for (size_t nStep = 1; ; nStep++)
+		{
+			uint32_t nMask = CHashGroup(pctrl + g * CHashGroup::WIDTH).MatchFree();
+
+			if (nMask != 0)
+				return g * CHashGroup::WIDTH + __builtin_ctz(nMask);
+
+			g = (g + nStep) & nGroupMask;
+		}
+	}
+
+	// Insert a value whose key is known to be absent
+	size_t InsertNew(const Slot& v)
+	{
+		size_t nHash = hasher(KeyOf::Get(v));
+		size_t i = nCapacity == 0 ? 0 : FindFree(nHash);
+
+		if (nCapacity == 0 || (nGrowthLeft == 0 && pctrl[i] == HASH_CTRL_EMPTY))
+		{
+			// Out of room. If much of the load is tombstones, clearing them
+			// is enough; otherwise grow
+			if (nCapacity != 0 && nSize <= MaxLoad(nCapacity) / 2)
+				Rehash(nCapacity);
+			else
+				Rehash(std::max(nCapacity * 2, (size_t)CHashGroup::WIDTH));
+			i = FindFree(nHash);
+		}
+
+		new (&pslots[i]) Slot(v);
+		if (pctrl[i] == HASH_CTRL_EMPTY)
+			nGrowthLeft--;
+		pctrl[i] = nHash & 0x7f;
+		nSize++;
+
+		return i;
+	}
+
+	void EraseAt(size_t i)
+	{
+		pslots[i].~Slot();
+		nSize--;
+
+		// A lookup stops at a group with an empty slot, so if the group had
+		// one already no probe sequence runs through it and the slot can go
+		// back to empty. Otherwise it has to stay a tombstone.
+		size_t g = i / CHashGroup::WIDTH * CHashGroup::WIDTH;
+		if (CHashGroup(pctrl + g).MatchEmpty() != 0)
+		{
+			pctrl[i] = HASH_CTRL_EMPTY;
+			nGrowthLeft++;
+		}
+		else
+		{
+			pctrl[i] = HASH_CTRL_DELETED;
+		}
+	}
+
+	void Rehash(size_t nNewCapacity)
+	{
+		// Control bytes and slots share one allocation; nNewCapacity is a
+		// multiple of 16, so the slots stay aligned
+		char* p = (char*)::operator new(nNewCapacity * (1 + sizeof(Slot)));
+		int8_t* pNewCtrl = (int8_t*)p;
+		Slot* pNewSlots = (Slot*)(p + nNewCapacity);
+		memset(pNewCtrl, HASH_CTRL_EMPTY, nNewCapacity);
+
+		int8_t* pOldCtrl = pctrl;
+		Slot* pOldSlots = pslots;
+		size_t nOldCapacity = nCapacity;
+
+		pctrl = pNewCtrl;
+		pslots = pNewSlots;
+		nCapacity = nNewCapacity;
+		nGrowthLeft = MaxLoad(nNewCapacity) - nSize;
+
+		for (size_t j = 0; j < nOldCapacity; j++)
+		{
+			if (pOldCtrl[j] < 0)
+				continue;
+
+			size_t nHash = hasher(KeyOf::Get(pOldSlots[j]));
+			size_t i = FindFree(nHash);
+			new (&pslots[i]) Slot(pOldSlots[j]);
+			pctrl[i] = nHash & 0x7f;
+			pOldSlots[j].~Slot();
+		}
+
+		::operator delete(pOldCtrl);
+	}
+
+	void Destroy()
+	{
+		for (size_t i = 0; i < nCapacity; i++)
+			if (pctrl[i] >= 0)
+				pslots[i].~Slot();
+		::operator delete(pctrl);
+	}
+};
+
+/**
+ * Hash set, mostly a drop-in for std::set where ordering is not needed.
+ * Serializes in the same format as std::set (in table order), so either
+ * container can read what the other wrote.
+ */
+template<typename K, typename Hasher = CSaltedHasher<K> >
+class CHashSet : public CHashTable<K, CHashIdentityKey<K>, Hasher>
+{
+	typedef CHashTable<K, CHashIdentityKey<K>, Hasher> base;
+
+public:
+	explicit CHashSet(const Hasher& hasherIn = Hasher()) : base(hasherIn) {}
+
+	unsigned int GetSerializeSize(int nType=0, int nVersion=PROTOCOL_VERSION) const
+	{
+		unsigned int nBytes = GetSizeOfCompactSize(this->size());
+		for (typename base::const_iterator it = this->begin(); it != this->end(); ++it)
+			nBytes += ::GetSerializeSize(*it, nType, nVersion);
+		return nBytes;
+	}
+
+	template<typename Stream>
+	void Serialize(Stream& s, int nType=0, int nVersion=PROTOCOL_VERSION) const
+	{
+		WriteCompactSize(s, this->size());
+		for (typename base::const_iterator it = this->begin(); it != this->end(); ++it)
+			::Serialize(s, *it, nType, nVersion);
+	}
+
+	template<typename Stream>
+	void Unserialize(Stream& s, int nType=0, int nVersion=PROTOCOL_VERSION)
+	{
+		this->clear();
+		unsigned int nCount = ReadCompactSize(s);
+		for (unsigned int i = 0; i < nCount; i++)
+		{
+			K key;
+			::Unserialize(s, key, nType, nVersion);
+			this->insert(key);
+		}
+	}
+};
+
+/**
+ * Hash map, mostly a drop-in for std::map where ordering is not needed.
+ * Serializes in the same format as std::map (in table order).
+ */
+template<typename K, typename T, typename Hasher = CSaltedHasher<K> >
+class CHashMap : public CHashTable<std::pair<const K, T>, CHashFirstKey<std::pair<const K, T> >, Hasher>
+{
+	typedef CHashTable<std::pair<const K, T>, CHashFirstKey<std::pair<const K, T> >, Hasher> base;
+
+public:
+	typedef T mapped_type;
+
+	explicit CHashMap(const Hasher& hasherIn = Hasher()) : base(hasherIn) {}
+
+	T& operator[](const K& key)
+	{
+		size_t i = this->Find(key);
+
+		if (i == this->nCapacity)
+			i = this->InsertNew(std::pair<const K, T>(key, T()));
+
+		return this->pslots[i].second;
+	}
+
+	unsigned int GetSerializeSize(int nType=0, int nVersion=PROTOCOL_VERSION) const
+	{
+		unsigned int nBytes = GetSizeOfCompactSize(this->size());
+		for (typename base::const_iterator it = this->begin(); it != this->end(); ++it)
+			nBytes += ::GetSerializeSize(it->first, nType, nVersion) + ::GetSerializeSize(it->second, nType, nVersion);
+		return nBytes;
+	}
+
+	template<typename Stream>
+	void Serialize(Stream& s, int nType=0, int nVersion=PROTOCOL_VERSION) const
+	{
+		WriteCompactSize(s, this->size());
+		for (typename base::const_iterator it = this->begin(); it != this->end(); ++it)
+		{
+			::Serialize(s, it->first, nType, nVersion);
+			::Serialize(s, it->second, nType, nVersion);
+		}
+	}
+
+	template<typename Stream>
+	void Unserialize(Stream& s, int nType=0, int nVersion=PROTOCOL_VERSION)
+	{
+		this->clear();
+		unsigned int nCount = ReadCompactSize(s);
+		for (unsigned int i = 0; i < nCount; i++)
+		{
+			std::pair<K, T> item;
+			::Unserialize(s, item.first, nType, nVersion);
+			::Unserialize(s, item.second, nType, nVersion);
+			this->insert(std::pair<const K, T>(item.first, item.second));
+		}
+	}
+};
+
+#endif // BITCOIN_HASHMAP_H
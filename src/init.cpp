@@ -1,38 +1,187 @@
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
 #include <signal.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
 #include <boost/thread.hpp>
 
 #include "init.h"
 #include "util.h"
 
-volatile bool fRequestShutdown = false;
+static bool fRequestShutdown = false;
 
+// Becomes readable, and stays so, once shutdown is requested. Created
+// before main() so that StartShutdown() never has to.
+static int fdShutdown = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+// SIGHUP writes a byte here for ThreadConfigReload (self-pipe)
+static int fdReloadPipe[2] = { -1, -1 };
+
+// How long ThreadConfigReload gets to notice shutdown and return
+static const int64_t CONFIG_RELOAD_STOP_MILLIS = 2000;
+
+static boost::thread* pthreadConfigReload = NULL;
+
+struct CShutdownPhase
+{
+	std::string strName;
+	int64_t nDeadlineMillis;
+	boost::function<void ()> fn;
+};
+
+static std::vector<CShutdownPhase> vShutdownPhases;
+static boost::mutex csShutdownPhases;
+
+static int64_t GetMonotonicMillis()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Async-signal-safe, so that the signal handlers can call it
 void StartShutdown()
 {
-    fRequestShutdown = true;
+	__atomic_store_n(&fRequestShutdown, true, __ATOMIC_RELEASE);
+
+	if (fdShutdown != -1)
+	{
+		int nSavedErrno = errno;
+		uint64_t n = 1;
+		if (write(fdShutdown, &n, sizeof(n)) < 0)
+		{
+			// Counter saturated: it is readable already
+		}
+		errno = nSavedErrno;
+	}
 }
 
 bool ShutdownRequested()
 {
-    return fRequestShutdown;
+	return __atomic_load_n(&fRequestShutdown, __ATOMIC_ACQUIRE);
+}
+
+int GetShutdownFd()
+{
+	return fdShutdown;
 }
 
-void Shutdown()
+bool WaitForShutdown(int64_t nTimeoutMillis)
 {
-	// Temporary empty.
+	int64_t nDeadline = GetMonotonicMillis() + nTimeoutMillis;
+
+	while (!ShutdownRequested())
+	{
+		int nWait = -1;
+		if (nTimeoutMillis >= 0)
+		{
+			int64_t nLeft = nDeadline - GetMonotonicMillis();
+			if (nLeft <= 0)
+			{
+				return false;
+			}
+
+			nWait = (int)std::min(nLeft, (int64_t)INT_MAX);
+		}
+
+		if (fdShutdown == -1)
+		{
+			// No eventfd: fall back to polling
+			MilliSleep(nWait < 0 ? 200 : std::min(nWait, 200));
+			continue;
+		}
+
+		struct pollfd pfd;
+		pfd.fd = fdShutdown;
+		pfd.events = POLLIN;
+		poll(&pfd, 1, nWait);
+	}
+
+	return true;
+}
+
+void RegisterShutdownPhase(const std::string& strName, int64_t nDeadlineMillis, const boost::function<void ()>& fn)
+{
+	CShutdownPhase phase;
+	phase.strName = strName;
+	phase.nDeadlineMillis = nDeadlineMillis;
+	phase.fn = fn;
+
+	boost::mutex::scoped_lock lock(csShutdownPhases);
+	vShutdownPhases.push_back(phase);
+}
+
+// Takes its own copy, which an abandoned phase can keep using
+static void RunShutdownPhase(CShutdownPhase phase)
+{
+	try
+	{
+		phase.fn();
+	}
+	catch (std::exception& e)
+	{
+		cout << "Shutdown phase " << phase.strName << " failed: " << e.what() << endl;
+	}
+}
+
+bool Shutdown()
+{
+	std::vector<CShutdownPhase> vPhases;
+	{
+		boost::mutex::scoped_lock lock(csShutdownPhases);
+		vPhases.swap(vShutdownPhases);
+	}
+
+	int64_t nStart = GetMonotonicMillis();
+	bool fAllDone = true;
+
+	// Each phase runs on its own thread, so that one that hangs can be
+	// left behind once its deadline passes; the process is exiting anyway
+	BOOST_FOREACH(const CShutdownPhase& phase, vPhases)
+	{
+		int64_t nPhaseStart = GetMonotonicMillis();
+
+		boost::thread thread(boost::bind(&RunShutdownPhase, phase));
+		bool fDone = thread.timed_join(boost::posix_time::milliseconds(phase.nDeadlineMillis));
+		if (!fDone)
+		{
+			thread.detach();
+			fAllDone = false;
+		}
+
+		cout << "Shutdown phase " << phase.strName << ": " << GetMonotonicMillis() - nPhaseStart << " ms"
+		     << (fDone ? "" : ", deadline exceeded, abandoned") << endl;
+	}
+
+	cout << "Shutdown took " << GetMonotonicMillis() - nStart << " ms" << endl;
+	return fAllDone;
 }
 
 void HandleSIGTERM(int)
 {
-	cout << __func__ << ": " << __LINE__ << endl;
-	fRequestShutdown = true;
+	StartShutdown();
 }
 
 void HandleSIGHUP(int)
 {
-	cout << __func__ << ": " << __LINE__ << endl;
-	// fReopenDebugLog = true;
+	// Only async-signal-safe calls here: ThreadConfigReload does the work
+	int nSavedErrno = errno;
+	char c = 0;
+	if (write(fdReloadPipe[1], &c, 1) < 0)
+	{
+		// Pipe full: a reload is pending anyway
+	}
+	errno = nSavedErrno;
 }
 
 void InitSigHandlers()
@@ -44,7 +193,12 @@ void InitSigHandlers()
 	sigaction(SIGTERM, &sa, NULL);
 	sigaction(SIGINT, &sa, NULL);
 
-	// Reopen debug.log on SIGHUP
+	// Reload the config file on SIGHUP
+	if (pipe2(fdReloadPipe, O_NONBLOCK | O_CLOEXEC) != 0)
+	{
+		cout << __func__ << ": pipe2() failed, SIGHUP will not reload the config" << endl;
+	}
+
 	struct sigaction sa_hup;
 	sa_hup.sa_handler = HandleSIGHUP;
 	sigemptyset(&sa_hup.sa_mask);
@@ -52,76 +206,81 @@ void InitSigHandlers()
 	sigaction(SIGHUP, &sa_hup, NULL);
 }
 
+// Runs while the configuration is (re)loaded, before it is published, so
+// it reads mapArgs through the *Unpublished() getters
 void InitParams()
 {
+	// bitcoind serves RPC unless told otherwise
+	SoftSetBoolArg(SETTING_SERVER, true);
+
 	// When specifying an explicit binding address, you want to listen on it
 	// even when -connect or -proxy is specified
-	if (mapArgs.count("-bind")) {
-		if (SoftSetBoolArg("-listen", true))
+	if (IsArgSetUnpublished(SETTING_BIND)) {
+		if (SoftSetBoolArg(SETTING_LISTEN, true))
 		{
 			LogPrintf("-bind set -> setting -listen=1\n");
 		}
 	}
 
 	// when only connecting to trusted nodes, do not seed via DNS, or listen by default
-	if (mapArgs.count("-connect") && mapMultiArgs["-connect"].size() > 0)
+	if (IsArgSetUnpublished(SETTING_CONNECT) && mapMultiArgs["-connect"].size() > 0)
 	{
-		if (SoftSetBoolArg("-dnsseed", false))
+		if (SoftSetBoolArg(SETTING_DNSSEED, false))
 		{
 			LogPrintf("-connect set -> setting -dnsseed=0\n");
 		}
 
-		if (SoftSetBoolArg("-listen", false))
+		if (SoftSetBoolArg(SETTING_LISTEN, false))
 		{
 			LogPrintf("-connect set -> setting -listen=0\n");
 		}
 	}
 
 	// To protect privacy, do not listen by default if a default proxy server is specified
-	if (mapArgs.count("-proxy"))
+	if (IsArgSetUnpublished(SETTING_PROXY))
 	{
-		if (SoftSetBoolArg("-listen", false))
+		if (SoftSetBoolArg(SETTING_LISTEN, false))
 		{
 			LogPrintf("-proxy set -> setting -listen=0\n");
 		}
 	}
 
 	// do not map ports or try to retrieve public IP when not listening (pointless)
-	if (!GetBoolArg("-listen", true))
+	if (!GetBoolArgUnpublished(SETTING_LISTEN))
 	{
-		if (SoftSetBoolArg("-upnp", false))
+		if (SoftSetBoolArg(SETTING_UPNP, false))
 		{
 			LogPrintf("-listen=0 -> setting -upnp=0\n");
 		}
 
-		if (SoftSetBoolArg("-discover", false))
+		if (SoftSetBoolArg(SETTING_DISCOVER, false))
 		{
 			LogPrintf("-listen=0 -> setting -discover=0\n");
 		}
 	}
 
 	// if an explicit public IP is specified, do not try to find others
-	if (mapArgs.count("-externalip"))
+	if (IsArgSetUnpublished(SETTING_EXTERNALIP))
 	{
-		if (SoftSetBoolArg("-discover", false))
+		if (SoftSetBoolArg(SETTING_DISCOVER, false))
 		{
 			LogPrintf("-externalip set -> setting -discover=0\n");
 		}
 	}
 
 	// Rewrite just private keys: rescan to find transactions
-	if (GetBoolArg("-salvagewallet", false))
+	if (GetBoolArgUnpublished(SETTING_SALVAGEWALLET))
 	{
-		if (SoftSetBoolArg("-rescan", true))
+		if (SoftSetBoolArg(SETTING_RESCAN, true))
 		{
 			LogPrintf("-salvagewallet=1 -> setting -rescan=1\n");
 		}
 	}
 
 	// -zapwallettx implies a rescan
-	if (GetBoolArg("-zapwallettxes", false))
+	if (GetBoolArgUnpublished(SETTING_ZAPWALLETTXES))
 	{
-		if (SoftSetBoolArg("-rescan", true))
+		if (SoftSetBoolArg(SETTING_RESCAN, true))
 		{
 			LogPrintf("-zapwallettxes=1 -> setting -rescan=1\n");
 		}
@@ -146,6 +305,117 @@ void InitCoinBaseFlags()
 	// COINBASE_FLAGS << vector<unsigned char>(p2sh, p2sh + strlen(p2sh));
 }
 
+static void LogSettingChange(const CSettingChange& change)
+{
+	cout << "config: " << change.strName << ": "
+	     << (change.fOldSet ? change.strOld : "(unset)") << " -> "
+	     << (change.fNewSet ? change.strNew : "(unset)") << endl;
+}
+
+static void ReloadConfig()
+{
+	if (ReloadConfigFile(InitParams))
+	{
+		LogPrintf("Config reloaded\n");
+	}
+}
+
+// Whether the inotify events in pchBuf name strFile
+static bool ConfigFileEvent(const char* pchBuf, ssize_t nLen, const string& strFile)
+{
+	bool fChanged = false;
+
+	for (ssize_t nPos = 0; nPos < nLen; )
+	{
+		const struct inotify_event* event = (const struct inotify_event*)(pchBuf + nPos);
+		if (event->len > 0 && strFile == event->name)
+		{
+			fChanged = true;
+		}
+
+		nPos += sizeof(struct inotify_event) + event->len;
+	}
+
+	return fChanged;
+}
+
+/**
+ * Reloads the config file on SIGHUP, and whenever the file is written or
+ * replaced. The directory is watched rather than the file, so that editors
+ * that save by renaming a new file over the old one are seen too.
+ */
+void ThreadConfigReload()
+{
+	boost::filesystem::path pathConfig = GetConfigFile();
+	string strFile = pathConfig.filename().string();
+
+	int fdInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fdInotify != -1 &&
+	    inotify_add_watch(fdInotify, pathConfig.parent_path().string().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) == -1)
+	{
+		close(fdInotify);
+		fdInotify = -1;
+	}
+
+	struct pollfd fds[3];
+	fds[0].fd = fdReloadPipe[0];
+	fds[0].events = POLLIN;
+	fds[1].fd = fdInotify;
+	fds[1].events = POLLIN;
+	fds[2].fd = GetShutdownFd();
+	fds[2].events = POLLIN;
+
+	// Without a shutdown fd, wake up now and then to check for shutdown
+	int nTimeout = (fds[2].fd == -1) ? 200 : -1;
+
+	while (!ShutdownRequested())
+	{
+		// Negative fds are skipped
+		if (poll(fds, 3, nTimeout) <= 0)
+		{
+			continue;
+		}
+
+		bool fReload = false;
+		char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+		ssize_t nRead;
+
+		if (fds[0].revents & POLLIN)
+		{
+			while (read(fdReloadPipe[0], buf, sizeof(buf)) > 0)
+				;
+			fReload = true;
+		}
+
+		if (fds[1].revents & POLLIN)
+		{
+			while ((nRead = read(fdInotify, buf, sizeof(buf))) > 0)
+			{
+				fReload |= ConfigFileEvent(buf, nRead, strFile);
+			}
+		}
+
+		if (fReload && !ShutdownRequested())
+		{
+			ReloadConfig();
+		}
+	}
+
+	if (fdInotify != -1)
+	{
+		close(fdInotify);
+	}
+}
+
+// Shutdown phase: ThreadConfigReload returns by itself once shutdown is
+// requested. Not deleted by Shutdown(), which may abandon this phase.
+static void StopConfigReload()
+{
+	pthreadConfigReload->join();
+	delete pthreadConfigReload;
+	pthreadConfigReload = NULL;
+}
+
 bool AppInit2(boost::thread_group& threadGroup)
 {
 	umask(077);
@@ -159,7 +429,11 @@ bool AppInit2(boost::thread_group& threadGroup)
 	InitParamsInternalFlags();
 
 	InitCoinBaseFlags();
-	
+
+	CSettings::Instance().NotifySettingChanged.connect(&LogSettingChange);
+	pthreadConfigReload = new boost::thread(&ThreadConfigReload);
+	RegisterShutdownPhase("config reload", CONFIG_RELOAD_STOP_MILLIS, &StopConfigReload);
+
 	return true;
 }
 
@@ -1,9 +1,32 @@
 #ifndef BITCOIN_INIT_H
 #define BITCOIN_INIT_H
 
+#include <stdint.h>
+#include <string>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
 void StartShutdown();
 bool ShutdownRequested();
-void Shutdown();
+
+// A file descriptor that polls readable once shutdown is requested, for
+// threads that already wait in poll(). Never read from it. -1 if the
+// kernel had no eventfd, in which case poll ShutdownRequested() instead.
+int GetShutdownFd();
+
+// Block until shutdown is requested or nTimeoutMillis (if not negative)
+// has passed; returns whether shutdown was requested
+bool WaitForShutdown(int64_t nTimeoutMillis = -1);
+
+// Have Shutdown() run fn, after the phases registered before it. A phase
+// still running nDeadlineMillis after it started is abandoned.
+void RegisterShutdownPhase(const std::string& strName, int64_t nDeadlineMillis, const boost::function<void ()>& fn);
+
+// Run the shutdown phases, reporting how long each took. Returns false if
+// one was abandoned: it may still be running, so nothing it uses may be
+// destroyed, and the process should _exit().
+bool Shutdown();
+
 bool AppInit2(boost::thread_group& threadGroup);
 
 #endif // BITCOIN_INIT_H
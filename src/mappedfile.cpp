@@ -0,0 +1,90 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <limits>
+
+#include "mappedfile.h"
+
+CMappedFile::CMappedFile(FILE *fileIn, int nTypeIn, int nVersionIn) :
+	pbegin(NULL), nSize(0), nReadPos(0), nReadLimit((uint64_t)(-1)),
+	state(0), exceptmask(std::ios_base::badbit | std::ios_base::failbit),
+	nType(nTypeIn), nVersion(nVersionIn)
+{
+	if (fileIn == NULL)
+	{
+		throw std::ios_base::failure("CMappedFile : file handle is NULL");
+	}
+
+	int fd = fileno(fileIn);
+	struct stat st;
+
+	if (fstat(fd, &st) != 0)
+	{
+		throw std::ios_base::failure("CMappedFile : fstat failed");
+	}
+
+	if ((uint64_t)st.st_size > std::numeric_limits<size_t>::max())
+	{
+		throw std::ios_base::failure("CMappedFile : file too large to map");
+	}
+
+	nSize = st.st_size;
+
+	// mmap() rejects empty mappings; an empty file is simply at eof
+	if (nSize != 0)
+	{
+		void* p = mmap(NULL, nSize, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (p == MAP_FAILED)
+		{
+			throw std::ios_base::failure("CMappedFile : mmap failed");
+		}
+
+		pbegin = (const char*)p;
+	}
+
+	long nPos = ftell(fileIn);
+
+	if (nPos > 0 && (uint64_t)nPos <= nSize)
+	{
+		nReadPos = nPos;
+	}
+}
+
+CMappedFile::~CMappedFile()
+{
+	if (pbegin != NULL)
+	{
+		munmap((void*)pbegin, nSize);
+	}
+}
+
+bool CMappedFile::AdviseSequential()
+{
+	if (pbegin == NULL)
+	{
+		return true;
+	}
+
+	return madvise((void*)pbegin, nSize, MADV_SEQUENTIAL) == 0;
+}
+
+bool CMappedFile::AdviseWillNeed(uint64_t nPos, uint64_t nLen)
+{
+	if (pbegin == NULL || nPos >= nSize)
+	{
+		return true;
+	}
+
+	if (nLen > nSize - nPos)
+	{
+		nLen = nSize - nPos;
+	}
+
+	// madvise() wants a page-aligned start address
+	static const uint64_t nPageSize = sysconf(_SC_PAGESIZE);
+	uint64_t nAlignedPos = nPos - (nPos % nPageSize);
+
+	return madvise((void*)(pbegin + nAlignedPos), nLen + (nPos - nAlignedPos), MADV_WILLNEED) == 0;
+}
@@ -0,0 +1,176 @@
+#ifndef BITCOIN_MAPPEDFILE_H
+#define BITCOIN_MAPPEDFILE_H
+
+#include <ios>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "scanner.h"
+#include "serialize.h"
+
+/** Memory-mapped, read-only replacement for CBufferedFile.
+ *
+ * The whole file is mapped when the object is created, so reads are plain
+ * copies out of the page cache: there is no rewind limit, and a single read
+ * may be as large as the file. Positions are absolute file offsets; reading
+ * starts at the FILE's current offset. The FILE* is not closed.
+ */
+class CMappedFile
+{
+private:
+    const char* pbegin;  // start of the mapping, NULL for an empty file
+    uint64_t nSize;      // size of the file when it was mapped
+    uint64_t nReadPos;   // how many bytes have been read from this
+    uint64_t nReadLimit; // up to which position we're allowed to read
+
+    short state;
+    short exceptmask;
+
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+
+protected:
+    void setstate(short bits, const char *psz) {
+        state |= bits;
+        if (state & exceptmask)
+            throw std::ios_base::failure(psz);
+    }
+
+public:
+    int nType;
+    int nVersion;
+
+    // Throws std::ios_base::failure if the file cannot be mapped
+    CMappedFile(FILE *fileIn, int nTypeIn, int nVersionIn);
+    ~CMappedFile();
+
+    // Hint that the file will be read front to back (MADV_SEQUENTIAL)
+    bool AdviseSequential();
+
+    // Ask the kernel to start paging in a range we are about to read (MADV_WILLNEED)
+    bool AdviseWillNeed(uint64_t nPos, uint64_t nLen);
+
+    // check whether no error occurred
+    bool good() const {
+        return state == 0;
+    }
+
+    // check whether we're at the end of the file
+    bool eof() const {
+        return nReadPos == nSize;
+    }
+
+    uint64_t size() const {
+        return nSize;
+    }
+
+    // read a number of bytes
+    CMappedFile& read(char *pch, size_t nRead) {
+        if (nRead + nReadPos > nReadLimit)
+            throw std::ios_base::failure("Read attempted past buffer limit");
+        if (nRead > nSize - nReadPos) {
+            size_t nAvail = nSize - nReadPos;
+            if (nAvail != 0)
+                memcpy(pch, pbegin + nReadPos, nAvail);
+            memset(pch + nAvail, 0, nRead - nAvail);
+            nReadPos = nSize;
+            setstate(std::ios_base::failbit, "CMappedFile::read : end of file");
+            return (*this);
+        }
+        memcpy(pch, pbegin + nReadPos, nRead);
+        nReadPos += nRead;
+        return (*this);
+    }
+
+    // Consume nRead bytes and return a pointer to them inside the mapping,
+    // or NULL if fewer than nRead bytes remain. Lets CByteView reference
+    // block data without copying it.
+    const char* ReadView(size_t nRead) {
+        if (nRead + nReadPos > nReadLimit)
+            throw std::ios_base::failure("Read attempted past buffer limit");
+        if (nRead > nSize - nReadPos) {
+            nReadPos = nSize;
+            setstate(std::ios_base::failbit, "CMappedFile::ReadView : end of file");
+            return NULL;
+        }
+        const char* p = pbegin + nReadPos;
+        nReadPos += nRead;
+        return p;
+    }
+
+    // return the current reading position
+    uint64_t GetPos() {
+        return nReadPos;
+    }
+
+    // rewind to a given reading position; every position in the file is available
+    bool SetPos(uint64_t nPos) {
+        if (nPos > nSize) {
+            nReadPos = nSize;
+            return false;
+        }
+        nReadPos = nPos;
+        return true;
+    }
+
+    bool Seek(uint64_t nPos) {
+        if (nPos > nSize)
+            return false;
+        nReadPos = nPos;
+        state = 0;
+        return true;
+    }
+
+    // prevent reading beyond a certain position
+    // no argument removes the limit
+    bool SetLimit(uint64_t nPos = (uint64_t)(-1)) {
+        if (nPos < nReadPos)
+            return false;
+        nReadLimit = nPos;
+        return true;
+    }
+
+    template<typename T>
+    CMappedFile& operator>>(T& obj) {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+
+    // search for a given byte in the stream, and remain positioned on it
+    void FindByte(char ch) {
+        const void* p = NULL;
+        if (nReadPos < nSize)
+            p = memchr(pbegin + nReadPos, ch, nSize - nReadPos);
+        if (p == NULL) {
+            nReadPos = nSize;
+            setstate(std::ios_base::failbit, "CMappedFile::FindByte : end of file");
+            return;
+        }
+        nReadPos = (const char*)p - pbegin;
+    }
+
+    // search for the 4-byte network magic, and remain positioned on it
+    void FindMessageStart(const unsigned char* pchMessageStart) {
+        const char* p = NULL;
+        if (nReadPos < nSize)
+            p = ::FindMessageStart(pbegin + nReadPos, pbegin + nSize, pchMessageStart);
+        if (p == NULL) {
+            nReadPos = nSize;
+            setstate(std::ios_base::failbit, "CMappedFile::FindMessageStart : end of file");
+            return;
+        }
+        nReadPos = p - pbegin;
+    }
+
+    // offsets of every candidate record start from the current position on,
+    // e.g. to recover the blocks of a damaged block file
+    void ScanMessageStarts(const unsigned char* pchMessageStart, std::vector<uint64_t>& vOffsets) {
+        if (nReadPos < nSize)
+            FindAllMessageStarts(pbegin + nReadPos, pbegin + nSize, pchMessageStart, nReadPos, vOffsets);
+    }
+};
+
+#endif // BITCOIN_MAPPEDFILE_H
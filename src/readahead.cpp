@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <deque>
+#include <string.h>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "readahead.h"
+
+using namespace std;
+
+static int64_t GetTimeMicrosMonotonic()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+class CReadAheadFile::Impl
+{
+public:
+	FILE* file;
+	size_t nChunkSize;
+	unsigned int nChunks;
+
+	// Protects everything below; fileMutex serializes use of the FILE*
+	boost::mutex mutex;
+	boost::mutex fileMutex;
+	boost::condition_variable condData;  // consumer waits for chunks
+	boost::condition_variable condSpace; // worker waits for free chunks
+
+	deque<vector<char>*> queue;  // chunks ready for the consumer
+	vector<vector<char>*> vFree; // recycled chunk buffers
+	size_t nFrontPos;            // consumed bytes of queue.front()
+	uint64_t nGeneration;        // bumped by Seek() to invalidate in-flight reads
+	bool fEof;
+	bool fError;
+	bool fStop;
+
+	CReadAheadStats stats;
+	int64_t nLastReturnMicros;
+
+	boost::thread thread;
+
+	Impl(FILE* fileIn, size_t nChunkSizeIn, unsigned int nChunksIn) :
+		file(fileIn), nChunkSize(max(nChunkSizeIn, (size_t)1)), nChunks(max(nChunksIn, 1U)), nFrontPos(0),
+		nGeneration(0), fEof(false), fError(false), fStop(false), nLastReturnMicros(0)
+	{
+		memset(&stats, 0, sizeof(stats));
+
+		for (unsigned int i = 0; i < nChunks; i++)
+		{
+			vFree.push_back(new vector<char>(nChunkSize));
+		}
+	}
+
+	~Impl()
+	{
+		for (size_t i = 0; i < queue.size(); i++)
+		{
+			delete queue[i];
+		}
+
+		for (size_t i = 0; i < vFree.size(); i++)
+		{
+			delete vFree[i];
+		}
+	}
+
+	void ThreadReadAhead();
+	void Clear();
+};
+
+void CReadAheadFile::Impl::Clear()
+{
+	while (!queue.empty())
+	{
+		vFree.push_back(queue.front());
+		queue.pop_front();
+	}
+
+	nFrontPos = 0;
+}
+
+void CReadAheadFile::Impl::ThreadReadAhead()
+{
+	while (true)
+	{
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+
+			while (!fStop && (vFree.empty() || fEof || fError))
+			{
+				condSpace.wait(lock);
+			}
+
+			if (fStop)
+			{
+				return;
+			}
+		}
+
+		boost::unique_lock<boost::mutex> lockFile(fileMutex);
+		vector<char>* pchunk;
+		uint64_t nReadGeneration;
+
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+
+			// A Seek() may have run while we were not holding fileMutex
+			if (fStop || vFree.empty() || fEof || fError)
+			{
+				continue;
+			}
+
+			pchunk = vFree.back();
+			vFree.pop_back();
+			nReadGeneration = nGeneration;
+		}
+
+		pchunk->resize(nChunkSize);
+		size_t nRead = fread(&(*pchunk)[0], 1, nChunkSize, file);
+		bool fFileEof = feof(file);
+		bool fFileError = ferror(file);
+		lockFile.unlock();
+
+		boost::unique_lock<boost::mutex> lock(mutex);
+
+		if (nReadGeneration != nGeneration)
+		{
+			// Data from before a Seek(); throw it away
+			vFree.push_back(pchunk);
+			continue;
+		}
+
+		if (nRead > 0)
+		{
+			pchunk->resize(nRead);
+			queue.push_back(pchunk);
+		}
+		else
+		{
+			vFree.push_back(pchunk);
+		}
+
+		if (nRead < nChunkSize)
+		{
+			fEof = fFileEof;
+			fError = fFileError || !fFileEof;
+		}
+
+		condData.notify_all();
+	}
+}
+
+CReadAheadFile::CReadAheadFile(FILE* fileIn, size_t nChunkSize, unsigned int nChunks) :
+	pimpl(new Impl(fileIn, nChunkSize, nChunks))
+{
+	pimpl->thread = boost::thread(boost::bind(&CReadAheadFile::Impl::ThreadReadAhead, pimpl));
+}
+
+CReadAheadFile::~CReadAheadFile()
+{
+	{
+		boost::unique_lock<boost::mutex> lock(pimpl->mutex);
+		pimpl->fStop = true;
+		pimpl->condSpace.notify_all();
+	}
+
+	pimpl->thread.join();
+	delete pimpl;
+}
+
+size_t CReadAheadFile::Read(void* pch, size_t nSize)
+{
+	boost::unique_lock<boost::mutex> lock(pimpl->mutex);
+	int64_t nNow = GetTimeMicrosMonotonic();
+
+	if (pimpl->nLastReturnMicros != 0)
+	{
+		pimpl->stats.nDecodeMicros += nNow - pimpl->nLastReturnMicros;
+	}
+
+	if (pimpl->queue.empty() && !pimpl->fEof && !pimpl->fError)
+	{
+		pimpl->stats.nStalls++;
+
+		while (pimpl->queue.empty() && !pimpl->fEof && !pimpl->fError)
+		{
+			pimpl->condData.wait(lock);
+		}
+
+		pimpl->stats.nStallMicros += GetTimeMicrosMonotonic() - nNow;
+	}
+
+	size_t nCopied = 0;
+
+	while (nCopied < nSize && !pimpl->queue.empty())
+	{
+		vector<char>* pchunk = pimpl->queue.front();
+		size_t nChunk = min(nSize - nCopied, pchunk->size() - pimpl->nFrontPos);
+
+		memcpy((char*)pch + nCopied, &(*pchunk)[pimpl->nFrontPos], nChunk);
+		nCopied += nChunk;
+		pimpl->nFrontPos += nChunk;
+
+		if (pimpl->nFrontPos == pchunk->size())
+		{
+			pimpl->queue.pop_front();
+			pimpl->vFree.push_back(pchunk);
+			pimpl->nFrontPos = 0;
+			pimpl->condSpace.notify_all();
+		}
+	}
+
+	pimpl->stats.nBytesRead += nCopied;
+	pimpl->nLastReturnMicros = GetTimeMicrosMonotonic();
+
+	return nCopied;
+}
+
+bool CReadAheadFile::Seek(uint64_t nPos)
+{
+	long nLongPos = nPos;
+
+	if (nPos != (uint64_t)nLongPos)
+	{
+		return false;
+	}
+
+	boost::unique_lock<boost::mutex> lockFile(pimpl->fileMutex);
+	bool fRet = (fseek(pimpl->file, nLongPos, SEEK_SET) == 0);
+
+	boost::unique_lock<boost::mutex> lock(pimpl->mutex);
+	pimpl->Clear();
+	pimpl->nGeneration++;
+	pimpl->fEof = false;
+	pimpl->fError = !fRet;
+	pimpl->condSpace.notify_all();
+
+	return fRet;
+}
+
+bool CReadAheadFile::eof()
+{
+	boost::unique_lock<boost::mutex> lock(pimpl->mutex);
+	return pimpl->queue.empty() && pimpl->fEof;
+}
+
+CReadAheadStats CReadAheadFile::GetStats()
+{
+	boost::unique_lock<boost::mutex> lock(pimpl->mutex);
+	return pimpl->stats;
+}
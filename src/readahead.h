@@ -0,0 +1,52 @@
+#ifndef BITCOIN_READAHEAD_H
+#define BITCOIN_READAHEAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** Where the consumer of a CReadAheadFile spent its time. */
+struct CReadAheadStats
+{
+	uint64_t nBytesRead;    // bytes handed to the consumer
+	uint64_t nStalls;       // reads that had to wait for the disk
+	int64_t nStallMicros;   // time spent waiting for the disk
+	int64_t nDecodeMicros;  // time spent between reads, i.e. deserializing
+};
+
+/**
+ * Background prefetcher for a FILE*.
+ *
+ * A worker thread keeps up to nChunks chunks of nChunkSize bytes read ahead
+ * of the consumer, so that the consumer usually finds data already in memory
+ * instead of blocking in fread(). Reads start at the file's current offset.
+ * While the prefetcher exists it owns the FILE* position: the consumer must
+ * go through Read() and Seek() only. The FILE* is not closed. Zero chunks or
+ * zero-byte chunks are taken as one, so that the worker can make progress.
+ */
+class CReadAheadFile
+{
+public:
+	CReadAheadFile(FILE* fileIn, size_t nChunkSize, unsigned int nChunks);
+	~CReadAheadFile();
+
+	// Like fread(): returns the number of bytes copied, 0 at end of file or on error
+	size_t Read(void* pch, size_t nSize);
+
+	// Reposition the file and drop everything read ahead so far
+	bool Seek(uint64_t nPos);
+
+	// Nothing left to read and the worker reached the end of the file
+	bool eof();
+
+	CReadAheadStats GetStats();
+
+private:
+	class Impl;
+	Impl* pimpl;
+
+	CReadAheadFile(const CReadAheadFile&);
+	CReadAheadFile& operator=(const CReadAheadFile&);
+};
+
+#endif // BITCOIN_READAHEAD_H
@@ -0,0 +1,139 @@
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define USE_X86_SIMD 1
+#endif
+
+#include "scanner.h"
+
+static const size_t MAGIC_SIZE = 4;
+
+static const char* FindMessageStartScalar(const char* pbegin, const char* pend, const unsigned char* pch)
+{
+	const char* p = pbegin;
+
+	while (pend - p >= (ptrdiff_t)MAGIC_SIZE)
+	{
+		p = (const char*)memchr(p, pch[0], pend - p - (MAGIC_SIZE - 1));
+
+		if (p == NULL)
+		{
+			return NULL;
+		}
+
+		if (memcmp(p, pch, MAGIC_SIZE) == 0)
+		{
+			return p;
+		}
+
+		p++;
+	}
+
+	return NULL;
+}
+
+#ifdef USE_X86_SIMD
+
+// SSE2 is part of the x86_64 baseline; 32-bit builds still check at runtime.
+// Each step tests 16 start positions: byte k of the magic is compared
+// against the block loaded at offset k, and the four masks are and-ed.
+__attribute__((target("sse2")))
+static const char* FindMessageStartSSE2(const char* pbegin, const char* pend, const unsigned char* pch)
+{
+	const __m128i v0 = _mm_set1_epi8(pch[0]);
+	const __m128i v1 = _mm_set1_epi8(pch[1]);
+	const __m128i v2 = _mm_set1_epi8(pch[2]);
+	const __m128i v3 = _mm_set1_epi8(pch[3]);
+	const char* p = pbegin;
+
+	while (pend - p >= (ptrdiff_t)(16 + MAGIC_SIZE - 1))
+	{
+		__m128i m = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), v0);
+		m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + 1)), v1));
+		m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + 2)), v2));
+		m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + 3)), v3));
+
+		unsigned int mask = _mm_movemask_epi8(m);
+
+		if (mask != 0)
+		{
+			return p + __builtin_ctz(mask);
+		}
+
+		p += 16;
+	}
+
+	return FindMessageStartScalar(p, pend, pch);
+}
+
+__attribute__((target("avx2")))
+static const char* FindMessageStartAVX2(const char* pbegin, const char* pend, const unsigned char* pch)
+{
+	const __m256i v0 = _mm256_set1_epi8(pch[0]);
+	const __m256i v1 = _mm256_set1_epi8(pch[1]);
+	const __m256i v2 = _mm256_set1_epi8(pch[2]);
+	const __m256i v3 = _mm256_set1_epi8(pch[3]);
+	const char* p = pbegin;
+
+	while (pend - p >= (ptrdiff_t)(32 + MAGIC_SIZE - 1))
+	{
+		__m256i m = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), v0);
+		m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + 1)), v1));
+		m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + 2)), v2));
+		m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + 3)), v3));
+
+		unsigned int mask = _mm256_movemask_epi8(m);
+
+		if (mask != 0)
+		{
+			return p + __builtin_ctz(mask);
+		}
+
+		p += 32;
+	}
+
+	return FindMessageStartScalar(p, pend, pch);
+}
+
+#endif // USE_X86_SIMD
+
+typedef const char* (*FindMessageStartFn)(const char*, const char*, const unsigned char*);
+
+static FindMessageStartFn SelectFindMessageStart()
+{
+#ifdef USE_X86_SIMD
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return FindMessageStartAVX2;
+	}
+
+	if (__builtin_cpu_supports("sse2"))
+	{
+		return FindMessageStartSSE2;
+	}
+#endif
+
+	return FindMessageStartScalar;
+}
+
+const char* FindMessageStart(const char* pbegin, const char* pend, const unsigned char* pchMessageStart)
+{
+	static const FindMessageStartFn find = SelectFindMessageStart();
+
+	return find(pbegin, pend, pchMessageStart);
+}
+
+void FindAllMessageStarts(const char* pbegin, const char* pend, const unsigned char* pchMessageStart,
+			  uint64_t nBase, std::vector<uint64_t>& vOffsets)
+{
+	const char* p = pbegin;
+
+	while ((p = FindMessageStart(p, pend, pchMessageStart)) != NULL)
+	{
+		vOffsets.push_back(nBase + (p - pbegin));
+		p++;
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef BITCOIN_SCANNER_H
+#define BITCOIN_SCANNER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Find the first occurrence of a 4-byte network magic
+ * (CChainParams::MessageStart()) in [pbegin, pend).
+ *
+ * Compares 32 (AVX2) or 16 (SSE2) candidate positions per step when the CPU
+ * supports it, with a memchr-based scalar fallback. Returns NULL if the
+ * range holds no complete match.
+ */
+const char* FindMessageStart(const char* pbegin, const char* pend, const unsigned char* pchMessageStart);
+
+/**
+ * Append the offset of every occurrence of the magic in [pbegin, pend) to
+ * vOffsets, as nBase plus the distance from pbegin. Overlapping matches are
+ * all reported; each is only a candidate record start.
+ */
+void FindAllMessageStarts(const char* pbegin, const char* pend, const unsigned char* pchMessageStart,
+			  uint64_t nBase, std::vector<uint64_t>& vOffsets);
+
+#endif // BITCOIN_SCANNER_H
@@ -2,11 +2,36 @@
 
 CScript& CScript::push_int64(int64_t n)
 {
-	if (n == -1 || (n >= 1 && n <= 16)) {
+	if (n == -1 || (n >= 1 && n <= 16))
+	{
 		push_back(n + (OP_1 - 1));
-	} else {
-		CBigNum bn(n);
-		*this << bn.getvch();
+		return *this;
+	}
+
+	// Same bytes as CBigNum(n).getvch(): little endian magnitude with the
+	// sign in the top bit of the last byte, built on the stack
+	unsigned char pch[sizeof(n) + 1];
+	unsigned int nSize = 0;
+	bool fNegative = n < 0;
+	uint64_t nAbs = fNegative ? ~(uint64_t)n + 1 : (uint64_t)n;
+
+	while (nAbs != 0)
+	{
+		pch[nSize++] = nAbs & 0xff;
+		nAbs >>= 8;
 	}
-}
 
+	if (nSize != 0)
+	{
+		if (pch[nSize - 1] & 0x80)
+		{
+			pch[nSize++] = (fNegative ? 0x80 : 0);
+		}
+		else if (fNegative)
+		{
+			pch[nSize - 1] |= 0x80;
+		}
+	}
+
+	return push_data(pch, nSize);
+}
@@ -26,11 +26,39 @@ class CScript : public vector<unsigned char>
 protected:
 	CScript& push_int64(int64_t n);
 
-	CScript& operator<<(const vector<unsigned char>& b)
+	// Push nSize bytes with the shortest OP_PUSHDATA* prefix
+	CScript& push_data(const unsigned char* pch, unsigned int nSize)
 	{
-		if (b.size() < OP_PUSHDATA1)
+		if (nSize < OP_PUSHDATA1)
+		{
+			push_back((unsigned char)nSize);
+		}
+		else if (nSize <= 0xff)
 		{
+			push_back(OP_PUSHDATA1);
+			push_back((unsigned char)nSize);
 		}
+		else if (nSize <= 0xffff)
+		{
+			push_back(OP_PUSHDATA2);
+			push_back(nSize & 0xff);
+			push_back((nSize >> 8) & 0xff);
+		}
+		else
+		{
+			push_back(OP_PUSHDATA4);
+			push_back(nSize & 0xff);
+			push_back((nSize >> 8) & 0xff);
+			push_back((nSize >> 16) & 0xff);
+			push_back((nSize >> 24) & 0xff);
+		}
+		insert(end(), pch, pch + nSize);
+		return *this;
+	}
+
+	CScript& operator<<(const vector<unsigned char>& b)
+	{
+		return push_data(b.empty() ? NULL : &b[0], b.size());
 	}
 };
 
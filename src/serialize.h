@@ -7,6 +7,8 @@
 #define BITCOIN_SERIALIZE_H
 
 #include "allocators.h"
+#include "readahead.h"
+#include "scanner.h"
 
 #include <algorithm>
 #include <assert.h>
@@ -21,11 +23,15 @@
 #include <vector>
 
 #include <boost/tuple/tuple.hpp>
+#include <boost/type_traits/integral_constant.hpp>
 #include <boost/type_traits/is_fundamental.hpp>
 
 class CAutoFile;
-class CDataStream;
+template<typename Alloc> class CBaseDataStream;
 class CScript;
+template<unsigned int BITS> class base_uint;
+class uint160;
+class uint256;
 
 static const unsigned int MAX_SIZE = 0x02000000;
 
@@ -341,6 +347,55 @@ public:
     }
 };
 
+/** Non-owning view of a length-prefixed byte vector or script.
+ *
+ * Serializes exactly like std::vector<unsigned char>, but unserializing
+ * points the view into the source stream's memory instead of copying.
+ * Only streams that can hand out stable pointers (CSpanReader) support it,
+ * and the view is valid only as long as the underlying region is.
+ */
+class CByteView
+{
+protected:
+    const unsigned char* pbegin;
+    unsigned int nSize;
+public:
+    CByteView() : pbegin(NULL), nSize(0) { }
+    CByteView(const unsigned char* pbeginIn, unsigned int nSizeIn) : pbegin(pbeginIn), nSize(nSizeIn) { }
+    const unsigned char* begin() const { return pbegin; }
+    const unsigned char* end() const { return pbegin + nSize; }
+    unsigned int size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+    unsigned char operator[](unsigned int pos) const { return pbegin[pos]; }
+
+    std::vector<unsigned char> ToVector() const
+    {
+        return std::vector<unsigned char>(begin(), end());
+    }
+
+    unsigned int GetSerializeSize(int, int=0) const
+    {
+        return GetSizeOfCompactSize(nSize) + nSize;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int, int=0) const
+    {
+        WriteCompactSize(s, nSize);
+        if (nSize != 0)
+            s.write((const char*)pbegin, nSize);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int, int=0)
+    {
+        nSize = ReadCompactSize(s);
+        pbegin = (const unsigned char*)s.ReadView(nSize);
+        if (pbegin == NULL)
+            nSize = 0;
+    }
+};
+
 template<typename I>
 class CVarInt
 {
@@ -367,6 +422,19 @@ public:
 template<typename I>
 CVarInt<I> WrapVarInt(I& n) { return CVarInt<I>(n); }
 
+/** Types whose wire format is exactly their sizeof(T) in-memory bytes.
+ *
+ * Vectors of such types are written and read with a single bulk
+ * write()/read(), and their serialized size is computed in O(1).
+ * Fundamental types qualify automatically; fixed-size records opt in by
+ * specializing this to boost::true_type, which is only correct if the
+ * type has no padding and its Serialize() is a plain copy of itself.
+ */
+template<typename T> struct is_flat_serializable : public boost::is_fundamental<T> { };
+template<unsigned int BITS> struct is_flat_serializable<base_uint<BITS> > : public boost::true_type { };
+template<> struct is_flat_serializable<uint160> : public boost::true_type { };
+template<> struct is_flat_serializable<uint256> : public boost::true_type { };
+
 //
 // Forward declarations
 //
@@ -498,7 +566,7 @@ unsigned int GetSerializeSize_impl(const std::vector<T, A>& v, int nType, int nV
 template<typename T, typename A>
 inline unsigned int GetSerializeSize(const std::vector<T, A>& v, int nType, int nVersion)
 {
-    return GetSerializeSize_impl(v, nType, nVersion, boost::is_fundamental<T>());
+    return GetSerializeSize_impl(v, nType, nVersion, is_flat_serializable<T>());
 }
 
 
@@ -521,7 +589,7 @@ void Serialize_impl(Stream& os, const std::vector<T, A>& v, int nType, int nVers
 template<typename Stream, typename T, typename A>
 inline void Serialize(Stream& os, const std::vector<T, A>& v, int nType, int nVersion)
 {
-    Serialize_impl(os, v, nType, nVersion, boost::is_fundamental<T>());
+    Serialize_impl(os, v, nType, nVersion, is_flat_serializable<T>());
 }
 
 
@@ -562,7 +630,7 @@ void Unserialize_impl(Stream& is, std::vector<T, A>& v, int nType, int nVersion,
 template<typename Stream, typename T, typename A>
 inline void Unserialize(Stream& is, std::vector<T, A>& v, int nType, int nVersion)
 {
-    Unserialize_impl(is, v, nType, nVersion, boost::is_fundamental<T>());
+    Unserialize_impl(is, v, nType, nVersion, is_flat_serializable<T>());
 }
 
 
@@ -796,15 +864,85 @@ struct ser_streamplaceholder
 
 typedef std::vector<char, zero_after_free_allocator<char> > CSerializeData;
 
+/** Write-only stream over a buffer that is already large enough.
+ *
+ * Used by SerializeToBuffer(): the buffer was sized from GetSerializeSize()
+ * up front, so write() is a plain memcpy into the cursor.
+ */
+class CBufferWriter
+{
+protected:
+    char* pcur;
+    char* pend;
+public:
+    int nType;
+    int nVersion;
+
+    CBufferWriter(char* pbeginIn, char* pendIn, int nTypeIn, int nVersionIn) :
+        pcur(pbeginIn), pend(pendIn), nType(nTypeIn), nVersion(nVersionIn) { }
+
+    size_t remaining() const     { return pend - pcur; }
+    int GetType()                { return nType; }
+    int GetVersion()             { return nVersion; }
+
+    CBufferWriter& write(const char* pch, size_t nSize)
+    {
+        assert(nSize <= remaining());
+        memcpy(pcur, pch, nSize);
+        pcur += nSize;
+        return (*this);
+    }
+
+    template<typename T>
+    CBufferWriter& operator<<(const T& obj)
+    {
+        // Serialize to this stream
+        ::Serialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
+/** Append the serialization of obj to vch, growing vch exactly once.
+ *
+ * The size comes from the object's GetSerializeSize(); an object whose
+ * Serialize() writes a different number of bytes trips the assertion.
+ */
+template<typename T, typename A>
+void SerializeToBuffer(const T& obj, std::vector<char, A>& vch, int nType, int nVersion)
+{
+    unsigned int nSize = ::GetSerializeSize(obj, nType, nVersion);
+    if (nSize == 0)
+        return;
+    size_t nOffset = vch.size();
+    vch.resize(nOffset + nSize);
+    CBufferWriter writer(&vch[nOffset], &vch[0] + vch.size(), nType, nVersion);
+    ::Serialize(writer, obj, nType, nVersion);
+    assert(writer.remaining() == 0);
+}
+
+template<typename T>
+CSerializeData SerializeToBuffer(const T& obj, int nType, int nVersion)
+{
+    CSerializeData vch;
+    SerializeToBuffer(obj, vch, nType, nVersion);
+    return vch;
+}
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
  * Fills with data in linear time; some stringstream implementations take N^2 time.
+ *
+ * The allocator decides whether the buffer is scrubbed when it is released:
+ * use CDataStream for anything that may hold key material, and
+ * CPublicDataStream for public payloads such as blocks and transactions,
+ * where wiping multi-megabyte buffers on every free is pure overhead.
  */
-class CDataStream
+template<typename Alloc>
+class CBaseDataStream
 {
 protected:
-    typedef CSerializeData vector_type;
+    typedef std::vector<char, Alloc> vector_type;
     vector_type vch;
     unsigned int nReadPos;
     short state;
@@ -813,44 +951,40 @@ public:
     int nType;
     int nVersion;
 
-    typedef vector_type::allocator_type   allocator_type;
-    typedef vector_type::size_type        size_type;
-    typedef vector_type::difference_type  difference_type;
-    typedef vector_type::reference        reference;
-    typedef vector_type::const_reference  const_reference;
-    typedef vector_type::value_type       value_type;
-    typedef vector_type::iterator         iterator;
-    typedef vector_type::const_iterator   const_iterator;
-    typedef vector_type::reverse_iterator reverse_iterator;
-
-    explicit CDataStream(int nTypeIn, int nVersionIn)
+    typedef typename vector_type::allocator_type   allocator_type;
+    typedef typename vector_type::size_type        size_type;
+    typedef typename vector_type::difference_type  difference_type;
+    typedef typename vector_type::reference        reference;
+    typedef typename vector_type::const_reference  const_reference;
+    typedef typename vector_type::value_type       value_type;
+    typedef typename vector_type::iterator         iterator;
+    typedef typename vector_type::const_iterator   const_iterator;
+    typedef typename vector_type::reverse_iterator reverse_iterator;
+
+    explicit CBaseDataStream(int nTypeIn, int nVersionIn)
     {
         Init(nTypeIn, nVersionIn);
     }
 
-    CDataStream(const_iterator pbegin, const_iterator pend, int nTypeIn, int nVersionIn) : vch(pbegin, pend)
+    CBaseDataStream(const_iterator pbegin, const_iterator pend, int nTypeIn, int nVersionIn) : vch(pbegin, pend)
     {
         Init(nTypeIn, nVersionIn);
     }
 
 #if !defined(_MSC_VER) || _MSC_VER >= 1300
-    CDataStream(const char* pbegin, const char* pend, int nTypeIn, int nVersionIn) : vch(pbegin, pend)
+    CBaseDataStream(const char* pbegin, const char* pend, int nTypeIn, int nVersionIn) : vch(pbegin, pend)
     {
         Init(nTypeIn, nVersionIn);
     }
 #endif
 
-    CDataStream(const vector_type& vchIn, int nTypeIn, int nVersionIn) : vch(vchIn.begin(), vchIn.end())
-    {
-        Init(nTypeIn, nVersionIn);
-    }
-
-    CDataStream(const std::vector<char>& vchIn, int nTypeIn, int nVersionIn) : vch(vchIn.begin(), vchIn.end())
+    template<typename A>
+    CBaseDataStream(const std::vector<char, A>& vchIn, int nTypeIn, int nVersionIn) : vch(vchIn.begin(), vchIn.end())
     {
         Init(nTypeIn, nVersionIn);
     }
 
-    CDataStream(const std::vector<unsigned char>& vchIn, int nTypeIn, int nVersionIn) : vch((char*)&vchIn.begin()[0], (char*)&vchIn.end()[0])
+    CBaseDataStream(const std::vector<unsigned char>& vchIn, int nTypeIn, int nVersionIn) : vch((char*)&vchIn.begin()[0], (char*)&vchIn.end()[0])
     {
         Init(nTypeIn, nVersionIn);
     }
@@ -864,15 +998,15 @@ public:
         exceptmask = std::ios::badbit | std::ios::failbit;
     }
 
-    CDataStream& operator+=(const CDataStream& b)
+    CBaseDataStream& operator+=(const CBaseDataStream& b)
     {
         vch.insert(vch.end(), b.begin(), b.end());
         return *this;
     }
 
-    friend CDataStream operator+(const CDataStream& a, const CDataStream& b)
+    friend CBaseDataStream operator+(const CBaseDataStream& a, const CBaseDataStream& b)
     {
-        CDataStream ret = a;
+        CBaseDataStream ret = a;
         ret += b;
         return (ret);
     }
@@ -997,7 +1131,7 @@ public:
     void clear(short n)          { state = n; }  // name conflict with vector clear()
     short exceptions()           { return exceptmask; }
     short exceptions(short mask) { short prev = exceptmask; exceptmask = mask; setstate(0, "CDataStream"); return prev; }
-    CDataStream* rdbuf()         { return this; }
+    CBaseDataStream* rdbuf()     { return this; }
     int in_avail()               { return size(); }
 
     void SetType(int n)          { nType = n; }
@@ -1007,7 +1141,7 @@ public:
     void ReadVersion()           { *this >> nVersion; }
     void WriteVersion()          { *this << nVersion; }
 
-    CDataStream& read(char* pch, int nSize)
+    CBaseDataStream& read(char* pch, int nSize)
     {
         // Read from the beginning of the buffer
         assert(nSize >= 0);
@@ -1030,7 +1164,7 @@ public:
         return (*this);
     }
 
-    CDataStream& ignore(int nSize)
+    CBaseDataStream& ignore(int nSize)
     {
         // Ignore from the beginning of the buffer
         assert(nSize >= 0);
@@ -1050,7 +1184,7 @@ public:
         return (*this);
     }
 
-    CDataStream& write(const char* pch, int nSize)
+    CBaseDataStream& write(const char* pch, int nSize)
     {
         // Write to the end of the buffer
         assert(nSize >= 0);
@@ -1074,7 +1208,7 @@ public:
     }
 
     template<typename T>
-    CDataStream& operator<<(const T& obj)
+    CBaseDataStream& operator<<(const T& obj)
     {
         // Serialize to this stream
         ::Serialize(*this, obj, nType, nVersion);
@@ -1082,19 +1216,156 @@ public:
     }
 
     template<typename T>
-    CDataStream& operator>>(T& obj)
+    CBaseDataStream& operator>>(T& obj)
     {
         // Unserialize from this stream
         ::Unserialize(*this, obj, nType, nVersion);
         return (*this);
     }
 
-    void GetAndClear(CSerializeData &data) {
+    template<typename T>
+    CBaseDataStream& SerializePresized(const T& obj)
+    {
+        // Like operator<<, but grows the buffer once to the predicted size
+        // instead of once per write()
+        ::SerializeToBuffer(obj, vch, nType, nVersion);
+        return (*this);
+    }
+
+    void GetAndClear(vector_type &data) {
         data.insert(data.end(), begin(), end());
         clear();
     }
 };
 
+typedef CBaseDataStream<zero_after_free_allocator<char> > CDataStream;
+typedef CBaseDataStream<std::allocator<char> > CPublicDataStream;
+
+
+
+/** Read-only stream over a borrowed, contiguous region of memory.
+ *
+ * Accepts the same ::Unserialize templates as CDataStream, but reads
+ * straight out of the caller's buffer (a socket buffer, an mmap'd block
+ * file, ...) without copying it into an owned vector first. The region
+ * must outlive the reader and every CByteView obtained from it.
+ */
+class CSpanReader
+{
+protected:
+    const char* pbegin;
+    unsigned int nSize;
+    unsigned int nReadPos;
+    short state;
+    short exceptmask;
+public:
+    int nType;
+    int nVersion;
+
+    CSpanReader(const char* pbeginIn, size_t nSizeIn, int nTypeIn, int nVersionIn) :
+        pbegin(pbeginIn), nSize(nSizeIn), nReadPos(0), state(0),
+        exceptmask(std::ios::badbit | std::ios::failbit), nType(nTypeIn), nVersion(nVersionIn)
+    {
+        assert(nSizeIn <= std::numeric_limits<unsigned int>::max());
+    }
+
+    //
+    // Buffer subset
+    //
+    const char* begin() const    { return pbegin + nReadPos; }
+    const char* end() const      { return pbegin + nSize; }
+    unsigned int size() const    { return nSize - nReadPos; }
+    bool empty() const           { return nReadPos == nSize; }
+    unsigned int GetPos() const  { return nReadPos; }
+
+    bool Rewind(unsigned int n)
+    {
+        // The whole region stays available, so any rewind up to the start succeeds
+        if (n > nReadPos)
+            return false;
+        nReadPos -= n;
+        return true;
+    }
+
+
+    //
+    // Stream subset
+    //
+    void setstate(short bits, const char* psz)
+    {
+        state |= bits;
+        if (state & exceptmask)
+            throw std::ios_base::failure(psz);
+    }
+
+    bool eof() const             { return size() == 0; }
+    bool fail() const            { return state & (std::ios::badbit | std::ios::failbit); }
+    bool good() const            { return !eof() && (state == 0); }
+    void clear(short n = 0)      { state = n; }
+    short exceptions()           { return exceptmask; }
+    short exceptions(short mask) { short prev = exceptmask; exceptmask = mask; setstate(0, "CSpanReader"); return prev; }
+
+    void SetType(int n)          { nType = n; }
+    int GetType()                { return nType; }
+    void SetVersion(int n)       { nVersion = n; }
+    int GetVersion()             { return nVersion; }
+    void ReadVersion()           { *this >> nVersion; }
+
+    CSpanReader& read(char* pch, size_t nRead)
+    {
+        if (nRead > size())
+        {
+            setstate(std::ios::failbit, "CSpanReader::read() : end of data");
+            memset(pch, 0, nRead);
+            nRead = size();
+        }
+        memcpy(pch, pbegin + nReadPos, nRead);
+        nReadPos += nRead;
+        return (*this);
+    }
+
+    CSpanReader& ignore(size_t nIgnore)
+    {
+        if (nIgnore > size())
+        {
+            setstate(std::ios::failbit, "CSpanReader::ignore() : end of data");
+            nIgnore = size();
+        }
+        nReadPos += nIgnore;
+        return (*this);
+    }
+
+    // Consume nRead bytes and return a pointer to them inside the region,
+    // or NULL if fewer than nRead bytes remain.
+    const char* ReadView(size_t nRead)
+    {
+        if (nRead > size())
+        {
+            setstate(std::ios::failbit, "CSpanReader::ReadView() : end of data");
+            nReadPos = nSize;
+            return NULL;
+        }
+        const char* p = pbegin + nReadPos;
+        nReadPos += nRead;
+        return p;
+    }
+
+    template<typename T>
+    unsigned int GetSerializeSize(const T& obj)
+    {
+        // Tells the size of the object if serialized to this stream
+        return ::GetSerializeSize(obj, nType, nVersion);
+    }
+
+    template<typename T>
+    CSpanReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 
 
 
@@ -1221,7 +1492,11 @@ public:
 
 /** Wrapper around a FILE* that implements a ring buffer to
  *  deserialize from. It guarantees the ability to rewind
- *  a given number of bytes. */
+ *  a given number of bytes.
+ *
+ *  With EnableReadAhead(), the ring buffer is refilled from chunks that a
+ *  background thread has already read, so disk I/O overlaps with
+ *  deserialization instead of stalling it. */
 class CBufferedFile
 {
 private:
@@ -1231,10 +1506,18 @@ private:
     uint64_t nReadLimit;  // up to which position we're allowed to read
     uint64_t nRewind;     // how many bytes we guarantee to rewind
     std::vector<char> vchBuf; // the buffer
+    CReadAheadFile *pReadAhead; // prefetcher owning src, if enabled
 
     short state;
     short exceptmask;
 
+    CBufferedFile(const CBufferedFile&);
+    CBufferedFile& operator=(const CBufferedFile&);
+
+    bool SourceEof() const {
+        return pReadAhead ? pReadAhead->eof() : feof(src);
+    }
+
 protected:
     void setstate(short bits, const char *psz) {
         state |= bits;
@@ -1251,9 +1534,13 @@ protected:
             readNow = nAvail;
         if (readNow == 0)
             return false;
-        size_t read = fread((void*)&vchBuf[pos], 1, readNow, src);
+        size_t read;
+        if (pReadAhead)
+            read = pReadAhead->Read((void*)&vchBuf[pos], readNow);
+        else
+            read = fread((void*)&vchBuf[pos], 1, readNow, src);
         if (read == 0) {
-            setstate(std::ios_base::failbit, feof(src) ? "CBufferedFile::Fill : end of file" : "CBufferedFile::Fill : fread failed");
+            setstate(std::ios_base::failbit, SourceEof() ? "CBufferedFile::Fill : end of file" : "CBufferedFile::Fill : fread failed");
             return false;
         } else {
             nSrcPos += read;
@@ -1267,7 +1554,27 @@ public:
 
     CBufferedFile(FILE *fileIn, uint64_t nBufSize, uint64_t nRewindIn, int nTypeIn, int nVersionIn) :
         src(fileIn), nSrcPos(0), nReadPos(0), nReadLimit((uint64_t)(-1)), nRewind(nRewindIn), vchBuf(nBufSize, 0),
-        state(0), exceptmask(std::ios_base::badbit | std::ios_base::failbit), nType(nTypeIn), nVersion(nVersionIn) {
+        pReadAhead(NULL), state(0), exceptmask(std::ios_base::badbit | std::ios_base::failbit), nType(nTypeIn), nVersion(nVersionIn) {
+    }
+
+    ~CBufferedFile() {
+        delete pReadAhead;
+    }
+
+    // Start a background thread that reads up to nChunks * nChunkSize bytes
+    // ahead of the ring buffer. From here on the file must only be
+    // accessed through this object.
+    void EnableReadAhead(size_t nChunkSize = 1 << 20, unsigned int nChunks = 4) {
+        if (!pReadAhead)
+            pReadAhead = new CReadAheadFile(src, nChunkSize, nChunks);
+    }
+
+    // Time spent waiting for the disk versus deserializing, if read-ahead is enabled
+    bool GetReadAheadStats(CReadAheadStats& stats) const {
+        if (!pReadAhead)
+            return false;
+        stats = pReadAhead->GetStats();
+        return true;
     }
 
     // check whether no error occurred
@@ -1277,7 +1584,7 @@ public:
 
     // check whether we're at the end of the source file
     bool eof() const {
-        return nReadPos == nSrcPos && feof(src);
+        return nReadPos == nSrcPos && SourceEof();
     }
 
     // read a number of bytes
@@ -1326,9 +1633,14 @@ public:
         long nLongPos = nPos;
         if (nPos != (uint64_t)nLongPos)
             return false;
-        if (fseek(src, nLongPos, SEEK_SET))
-            return false;
-        nLongPos = ftell(src);
+        if (pReadAhead) {
+            if (!pReadAhead->Seek(nPos))
+                return false;
+        } else {
+            if (fseek(src, nLongPos, SEEK_SET))
+                return false;
+            nLongPos = ftell(src);
+        }
         nSrcPos = nLongPos;
         nReadPos = nLongPos;
         state = 0;
@@ -1361,6 +1673,38 @@ public:
             nReadPos++;
         }
     }
+
+    // search for the 4-byte network magic, and remain positioned on it;
+    // like FindByte(), running out of data is reported through setstate()
+    bool FindMessageStart(const unsigned char* pchMessageStart) {
+        while (true) {
+            while (nSrcPos - nReadPos < 4) {
+                if (!Fill())
+                    return false;
+            }
+            unsigned int pos = nReadPos % vchBuf.size();
+            uint64_t nNow = std::min(nSrcPos - nReadPos, (uint64_t)(vchBuf.size() - pos));
+            if (nNow >= 4) {
+                // scan the contiguous part of the ring buffer in one go
+                const char* pbegin = &vchBuf[pos];
+                const char* p = ::FindMessageStart(pbegin, pbegin + nNow, pchMessageStart);
+                if (p != NULL) {
+                    nReadPos += p - pbegin;
+                    return true;
+                }
+                // the last 3 positions may start a match that continues past this span
+                nReadPos += nNow - 3;
+            } else {
+                // candidate straddles the end of the ring buffer
+                bool fMatch = true;
+                for (unsigned int i = 0; i < 4 && fMatch; i++)
+                    fMatch = ((unsigned char)vchBuf[(nReadPos + i) % vchBuf.size()] == pchMessageStart[i]);
+                if (fMatch)
+                    return true;
+                nReadPos++;
+            }
+        }
+    }
 };
 
 #endif
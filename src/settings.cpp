@@ -0,0 +1,323 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <set>
+#include <stdexcept>
+#include <boost/foreach.hpp>
+#include <boost/thread/tss.hpp>
+
+#include "settings.h"
+
+using namespace std;
+
+struct CBuiltinSetting
+{
+	SettingHandle h;
+	const char* pszName;
+	SettingType type;
+	const char* pszDefault;
+};
+
+static const CBuiltinSetting vBuiltinSettings[] =
+{
+	{ SETTING_BIND,          "-bind",          SETTING_STRING, "" },
+	{ SETTING_CONF,          "-conf",          SETTING_STRING, "bitcoin.conf" },
+	{ SETTING_CONNECT,       "-connect",       SETTING_STRING, "" },
+	{ SETTING_DATADIR,       "-datadir",       SETTING_STRING, "" },
+	{ SETTING_DISCOVER,      "-discover",      SETTING_BOOL,   "1" },
+	{ SETTING_DNSSEED,       "-dnsseed",       SETTING_BOOL,   "1" },
+	{ SETTING_EXTERNALIP,    "-externalip",    SETTING_STRING, "" },
+	{ SETTING_LISTEN,        "-listen",        SETTING_BOOL,   "1" },
+	{ SETTING_PROXY,         "-proxy",         SETTING_STRING, "" },
+	{ SETTING_REGTEST,       "-regtest",       SETTING_BOOL,   "0" },
+	{ SETTING_RESCAN,        "-rescan",        SETTING_BOOL,   "0" },
+	{ SETTING_SALVAGEWALLET, "-salvagewallet", SETTING_BOOL,   "0" },
+	{ SETTING_SERVER,        "-server",        SETTING_BOOL,   "0" },
+	{ SETTING_TESTNET,       "-testnet",       SETTING_BOOL,   "0" },
+	{ SETTING_UPNP,          "-upnp",          SETTING_BOOL,   "0" },
+	{ SETTING_ZAPWALLETTXES, "-zapwallettxes", SETTING_BOOL,   "0" },
+};
+
+// Same rules as GetBoolArg(): a bare -foo is true, otherwise the number
+static int64_t ParseSetting(SettingType type, const string& strValue)
+{
+	switch (type)
+	{
+	case SETTING_BOOL:
+		return strValue.empty() || atoi(strValue.c_str()) != 0;
+	case SETTING_INT:
+		return strtoll(strValue.c_str(), NULL, 10);
+	default:
+		return 0;
+	}
+}
+
+CSettings& CSettings::Instance()
+{
+	// Leaked, so that settings can still be read from static destructors
+	static CSettings* pinstance = new CSettings();
+	return *pinstance;
+}
+
+CSettings::CSettings() : nSettings(0)
+{
+	pSnapshot = new CSettingsSnapshot(map<string, string>(), map<string, vector<string> >(), 0);
+
+	for (size_t i = 0; i < sizeof(vBuiltinSettings) / sizeof(vBuiltinSettings[0]); i++)
+	{
+		const CBuiltinSetting& builtin = vBuiltinSettings[i];
+		SettingHandle h = Register(builtin.pszName, builtin.type, builtin.pszDefault);
+		(void)h;
+		assert(h == builtin.h);
+	}
+}
+
+SettingHandle CSettings::Register(const string& strName, SettingType type, const string& strDefault)
+{
+	boost::mutex::scoped_lock lock(mutex);
+
+	map<string, SettingHandle>::const_iterator it = mapHandle.find(strName);
+	if (it != mapHandle.end())
+	{
+		return it->second;
+	}
+
+	if (nSettings == MAX_SETTINGS)
+	{
+		throw runtime_error("CSettings::Register() : too many settings");
+	}
+
+	SettingHandle h = nSettings++;
+	CSetting& setting = vSetting[h];
+	setting.strName = strName;
+	setting.type = type;
+	setting.strDefault = strDefault;
+	Set(setting, *pSnapshot);
+
+	mapHandle.insert(make_pair(strName, h));
+	return h;
+}
+
+SettingHandle CSettings::Find(const string& strName) const
+{
+	boost::mutex::scoped_lock lock(mutex);
+
+	map<string, SettingHandle>::const_iterator it = mapHandle.find(strName);
+	return (it == mapHandle.end()) ? SETTING_NONE : it->second;
+}
+
+// Add to setChanged the keys whose values differ between mapOld and mapNew
+template<typename Map>
+static void DiffKeys(const Map& mapOld, const Map& mapNew, set<string>& setChanged)
+{
+	typename Map::const_iterator itOld = mapOld.begin();
+	typename Map::const_iterator itNew = mapNew.begin();
+
+	while (itOld != mapOld.end() || itNew != mapNew.end())
+	{
+		if (itNew == mapNew.end() || (itOld != mapOld.end() && itOld->first < itNew->first))
+		{
+			setChanged.insert(itOld->first);
+			++itOld;
+		}
+		else if (itOld == mapOld.end() || itNew->first < itOld->first)
+		{
+			setChanged.insert(itNew->first);
+			++itNew;
+		}
+		else
+		{
+			if (itOld->second != itNew->second)
+				setChanged.insert(itOld->first);
+			++itOld;
+			++itNew;
+		}
+	}
+}
+
+static void DiffSnapshots(const CSettingsSnapshot& oldSnapshot, const CSettingsSnapshot& newSnapshot,
+			  vector<CSettingChange>& vChanges)
+{
+	set<string> setChanged;
+	DiffKeys(oldSnapshot.mapArgs, newSnapshot.mapArgs, setChanged);
+	DiffKeys(oldSnapshot.mapMultiArgs, newSnapshot.mapMultiArgs, setChanged);
+
+	BOOST_FOREACH(const string& strName, setChanged)
+	{
+		CSettingChange change;
+		change.strName = strName;
+
+		map<string, string>::const_iterator it = oldSnapshot.mapArgs.find(strName);
+		change.fOldSet = (it != oldSnapshot.mapArgs.end());
+		if (change.fOldSet)
+			change.strOld = it->second;
+
+		it = newSnapshot.mapArgs.find(strName);
+		change.fNewSet = (it != newSnapshot.mapArgs.end());
+		if (change.fNewSet)
+			change.strNew = it->second;
+
+		vChanges.push_back(change);
+	}
+}
+
+void CSettings::Publish(const map<string, string>& mapArgsIn,
+			const map<string, vector<string> >& mapMultiArgsIn)
+{
+	vector<CSettingChange> vChanges;
+
+	{
+		boost::mutex::scoped_lock lock(mutex);
+
+		const CSettingsSnapshot* pOld = pSnapshot;
+		const CSettingsSnapshot* pNew = new CSettingsSnapshot(mapArgsIn, mapMultiArgsIn, pOld->nGeneration + 1);
+
+		// Seq-cst, so that FreeRetired() sees every hazard set by a reader
+		// that may have loaded pOld
+		__atomic_store_n(&pSnapshot, pNew, __ATOMIC_SEQ_CST);
+
+		for (SettingHandle h = 0; h < nSettings; h++)
+		{
+			Set(vSetting[h], *pNew);
+		}
+
+		DiffSnapshots(*pOld, *pNew, vChanges);
+
+		vRetired.push_back(pOld);
+		FreeRetired();
+	}
+
+	// Outside the lock, so that handlers can read and register settings
+	BOOST_FOREACH(const CSettingChange& change, vChanges)
+	{
+		NotifySettingChanged(change);
+	}
+}
+
+string CSettings::GetString(SettingHandle h) const
+{
+	CSettingsSnapshotRef snapshot;
+
+	map<string, string>::const_iterator it = snapshot->mapArgs.find(vSetting[h].strName);
+	return (it == snapshot->mapArgs.end()) ? vSetting[h].strDefault : it->second;
+}
+
+// Called with mutex held
+void CSettings::Set(CSetting& setting, const CSettingsSnapshot& snapshot)
+{
+	map<string, string>::const_iterator it = snapshot.mapArgs.find(setting.strName);
+	bool fSet = (it != snapshot.mapArgs.end());
+
+	__atomic_store_n(&setting.nValue, ParseSetting(setting.type, fSet ? it->second : setting.strDefault), __ATOMIC_RELAXED);
+	__atomic_store_n(&setting.fSet, fSet, __ATOMIC_RELAXED);
+}
+
+//
+// Hazard pointers: each reading thread owns a record naming the snapshot it
+// is using, and a retired snapshot is freed once no record names it.
+// Records are never freed, only handed to another thread once their owner
+// has exited.
+//
+struct CSnapshotHazard
+{
+	const CSettingsSnapshot* pSnapshot;
+	int nDepth;             // nested CSettingsSnapshotRefs, owner only
+	bool fInUse;            // owned by a live thread
+	CSnapshotHazard* pNext; // fixed once the record is linked
+};
+
+static CSnapshotHazard* pHazardList = NULL;
+static __thread CSnapshotHazard* pThreadHazard = NULL;
+
+// Run by boost::thread_specific_ptr when a thread exits
+static void ReleaseHazard(CSnapshotHazard* pHazard)
+{
+	if (pThreadHazard == pHazard)
+		pThreadHazard = NULL;
+	__atomic_store_n(&pHazard->fInUse, false, __ATOMIC_RELEASE);
+}
+
+static CSnapshotHazard* ThreadHazard()
+{
+	if (pThreadHazard != NULL)
+		return pThreadHazard;
+
+	static boost::thread_specific_ptr<CSnapshotHazard>* pOwner =
+		new boost::thread_specific_ptr<CSnapshotHazard>(ReleaseHazard);
+
+	CSnapshotHazard* pHazard;
+	for (pHazard = __atomic_load_n(&pHazardList, __ATOMIC_ACQUIRE); pHazard != NULL; pHazard = pHazard->pNext)
+	{
+		bool fFalse = false;
+		if (!__atomic_load_n(&pHazard->fInUse, __ATOMIC_RELAXED) &&
+		    __atomic_compare_exchange_n(&pHazard->fInUse, &fFalse, true, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+	}
+
+	if (pHazard == NULL)
+	{
+		pHazard = new CSnapshotHazard();
+		pHazard->pSnapshot = NULL;
+		pHazard->nDepth = 0;
+		pHazard->fInUse = true;
+		pHazard->pNext = __atomic_load_n(&pHazardList, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&pHazardList, &pHazard->pNext, pHazard, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			;
+	}
+
+	pOwner->reset(pHazard);
+	pThreadHazard = pHazard;
+	return pHazard;
+}
+
+const CSettingsSnapshot* CSettings::AcquireSnapshot()
+{
+	CSettings& settings = Instance();
+	CSnapshotHazard* pHazard = ThreadHazard();
+
+	if (pHazard->nDepth++ > 0)
+		return pHazard->pSnapshot;
+
+	// Once the hazard is visible, a snapshot that is still current after
+	// it was set cannot be freed until the hazard is cleared
+	const CSettingsSnapshot* p = __atomic_load_n(&settings.pSnapshot, __ATOMIC_ACQUIRE);
+	while (true)
+	{
+		__atomic_store_n(&pHazard->pSnapshot, p, __ATOMIC_SEQ_CST);
+
+		const CSettingsSnapshot* pCurrent = __atomic_load_n(&settings.pSnapshot, __ATOMIC_SEQ_CST);
+		if (pCurrent == p)
+			return p;
+		p = pCurrent;
+	}
+}
+
+void CSettings::ReleaseSnapshot()
+{
+	CSnapshotHazard* pHazard = pThreadHazard;
+
+	if (--pHazard->nDepth == 0)
+		__atomic_store_n(&pHazard->pSnapshot, (const CSettingsSnapshot*)NULL, __ATOMIC_RELEASE);
+}
+
+// Called with mutex held
+void CSettings::FreeRetired()
+{
+	set<const CSettingsSnapshot*> setHeld;
+	for (CSnapshotHazard* pHazard = __atomic_load_n(&pHazardList, __ATOMIC_ACQUIRE); pHazard != NULL; pHazard = pHazard->pNext)
+	{
+		const CSettingsSnapshot* p = __atomic_load_n(&pHazard->pSnapshot, __ATOMIC_SEQ_CST);
+		if (p != NULL)
+			setHeld.insert(p);
+	}
+
+	vector<const CSettingsSnapshot*> vStillHeld;
+	BOOST_FOREACH(const CSettingsSnapshot* p, vRetired)
+	{
+		if (setHeld.count(p))
+			vStillHeld.push_back(p);
+		else
+			delete p;
+	}
+
+	vRetired.swap(vStillHeld);
+}
@@ -0,0 +1,207 @@
+#ifndef BITCOIN_SETTINGS_H
+#define BITCOIN_SETTINGS_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/signals2/signal.hpp>
+#include <boost/thread/mutex.hpp>
+
+enum SettingType
+{
+	SETTING_BOOL,
+	SETTING_INT,
+	SETTING_STRING,
+};
+
+/**
+ * Handles of the options bitcoind itself knows about, in the order of the
+ * table in settings.cpp. Options registered later get the handles after
+ * MAX_BUILTIN_SETTINGS.
+ */
+enum
+{
+	SETTING_BIND,
+	SETTING_CONF,
+	SETTING_CONNECT,
+	SETTING_DATADIR,
+	SETTING_DISCOVER,
+	SETTING_DNSSEED,
+	SETTING_EXTERNALIP,
+	SETTING_LISTEN,
+	SETTING_PROXY,
+	SETTING_REGTEST,
+	SETTING_RESCAN,
+	SETTING_SALVAGEWALLET,
+	SETTING_SERVER,
+	SETTING_TESTNET,
+	SETTING_UPNP,
+	SETTING_ZAPWALLETTXES,
+	MAX_BUILTIN_SETTINGS
+};
+
+typedef int SettingHandle;
+
+static const SettingHandle SETTING_NONE = -1;
+static const int MAX_SETTINGS = 256;
+
+/** One published state of the options; never changes once published */
+class CSettingsSnapshot
+{
+public:
+	const std::map<std::string, std::string> mapArgs;
+	const std::map<std::string, std::vector<std::string> > mapMultiArgs;
+
+	// 0 for the empty snapshot before the first Publish(), then counting up
+	const uint64_t nGeneration;
+
+	CSettingsSnapshot(const std::map<std::string, std::string>& mapArgsIn,
+			  const std::map<std::string, std::vector<std::string> >& mapMultiArgsIn,
+			  uint64_t nGenerationIn)
+		: mapArgs(mapArgsIn), mapMultiArgs(mapMultiArgsIn), nGeneration(nGenerationIn)
+	{
+	}
+};
+
+/** How one option differs between two consecutive snapshots */
+struct CSettingChange
+{
+	std::string strName;
+	bool fOldSet;
+	std::string strOld;
+	bool fNewSet;
+	std::string strNew;
+};
+
+/**
+ * Registry of typed options, each declared once with its type and default
+ * and then addressed by an integer handle instead of its name.
+ *
+ * mapArgs and mapMultiArgs are only written by the thread that (re)loads
+ * the configuration, which then calls Publish(). Publish() copies them into
+ * a new immutable snapshot, swaps it in with one atomic store and notifies
+ * NotifySettingChanged once per option that changed. Retired snapshots are
+ * freed once no reader holds them (hazard pointers), so readers on other
+ * threads never take a lock and never see a half-updated map.
+ *
+ * Bool and int values of registered options are also kept parsed, for a
+ * single relaxed atomic load per read. These are updated one by one after
+ * the snapshot is swapped; use a CSettingsSnapshotRef when several options
+ * must be read from the same configuration.
+ */
+class CSettings
+{
+public:
+	static CSettings& Instance();
+
+	// Handle of strName (e.g. "-listen"), registering it if needed
+	SettingHandle Register(const std::string& strName, SettingType type, const std::string& strDefault);
+
+	// Handle of strName, or SETTING_NONE if it was never registered
+	SettingHandle Find(const std::string& strName) const;
+
+	// Make mapArgsIn and mapMultiArgsIn the current configuration
+	void Publish(const std::map<std::string, std::string>& mapArgsIn,
+		     const std::map<std::string, std::vector<std::string> >& mapMultiArgsIn);
+
+	bool IsSet(SettingHandle h) const
+	{
+		return __atomic_load_n(&vSetting[h].fSet, __ATOMIC_RELAXED);
+	}
+
+	bool GetBool(SettingHandle h) const
+	{
+		return __atomic_load_n(&vSetting[h].nValue, __ATOMIC_RELAXED) != 0;
+	}
+
+	int64_t GetInt(SettingHandle h) const
+	{
+		return __atomic_load_n(&vSetting[h].nValue, __ATOMIC_RELAXED);
+	}
+
+	// From the current snapshot, or the default if unset
+	std::string GetString(SettingHandle h) const;
+
+	const std::string& GetName(SettingHandle h) const
+	{
+		return vSetting[h].strName;
+	}
+
+	const std::string& GetDefault(SettingHandle h) const
+	{
+		return vSetting[h].strDefault;
+	}
+
+	SettingType GetType(SettingHandle h) const
+	{
+		return vSetting[h].type;
+	}
+
+	// Called on the publishing thread, after the new snapshot is visible
+	boost::signals2::signal<void (const CSettingChange& change)> NotifySettingChanged;
+
+private:
+	friend class CSettingsSnapshotRef;
+
+	struct CSetting
+	{
+		// Fixed at registration
+		std::string strName;
+		SettingType type;
+		std::string strDefault;
+
+		// The parsed value, or the parsed default when unset
+		int64_t nValue;
+		bool fSet;
+	};
+
+	CSetting vSetting[MAX_SETTINGS];
+	int nSettings;
+
+	std::map<std::string, SettingHandle> mapHandle;
+
+	// Current snapshot, and the replaced ones that readers may still hold
+	const CSettingsSnapshot* pSnapshot;
+	std::vector<const CSettingsSnapshot*> vRetired;
+
+	// Guards everything but the atomics and NotifySettingChanged
+	mutable boost::mutex mutex;
+
+	CSettings();
+
+	void Set(CSetting& setting, const CSettingsSnapshot& snapshot);
+	void FreeRetired();
+
+	static const CSettingsSnapshot* AcquireSnapshot();
+	static void ReleaseSnapshot();
+};
+
+/**
+ * Pins the current snapshot for as long as it lives. Taking one costs a
+ * few atomic operations and no lock; a nested one on the same thread
+ * returns the snapshot its outer one pinned.
+ */
+class CSettingsSnapshotRef
+{
+public:
+	CSettingsSnapshotRef() : pSnapshot(CSettings::AcquireSnapshot())
+	{
+	}
+
+	~CSettingsSnapshotRef()
+	{
+		CSettings::ReleaseSnapshot();
+	}
+
+	const CSettingsSnapshot& operator*() const { return *pSnapshot; }
+	const CSettingsSnapshot* operator->() const { return pSnapshot; }
+
+private:
+	const CSettingsSnapshot* pSnapshot;
+
+	CSettingsSnapshotRef(const CSettingsSnapshotRef&);
+	CSettingsSnapshotRef& operator=(const CSettingsSnapshotRef&);
+};
+
+#endif // BITCOIN_SETTINGS_H
@@ -0,0 +1,302 @@
+#ifndef BITCOIN_SORTEDHASH_H
+#define BITCOIN_SORTEDHASH_H
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "core.h"
+#include "serialize.h"
+#include "uint256.h"
+#include "version.h"
+
+/**
+ * How a hash-like type sorts, as a string of KEY_SIZE bytes compared most
+ * significant first, consistent with its operator<. Prefix() is the first 8
+ * of those bytes as an integer.
+ */
+template<typename T> struct CHashSortKey;
+
+template<>
+struct CHashSortKey<uint256>
+{
+	enum { KEY_SIZE = 32 };
+
+	// base_uint is little endian: byte 31 is the most significant
+	static unsigned char Byte(const uint256& hash, unsigned int i)
+	{
+		return hash.begin()[31 - i];
+	}
+
+	static uint64_t Prefix(const uint256& hash)
+	{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		uint64_t n;
+		memcpy(&n, hash.begin() + 24, sizeof(n));
+		return n;
+#else
+		uint64_t n = 0;
+		for (int i = 31; i >= 24; i--)
+			n = n << 8 | hash.begin()[i];
+		return n;
+#endif
+	}
+};
+
+template<>
+struct CHashSortKey<COutPoint>
+{
+	enum { KEY_SIZE = 36 };
+
+	static unsigned char Byte(const COutPoint& outpoint, unsigned int i)
+	{
+		if (i < 32)
+			return outpoint.hash.begin()[31 - i];
+		return (outpoint.n >> (8 * (35 - i))) & 0xff;
+	}
+
+	static uint64_t Prefix(const COutPoint& outpoint)
+	{
+		return CHashSortKey<uint256>::Prefix(outpoint.hash);
+	}
+};
+
+// Below this many elements a bucket is left to std::sort
+static const size_t RADIX_SORT_CUTOFF = 64;
+
+/**
+ * MSD radix sort on the key bytes, using pTmp (n elements) as scratch. Hashes
+ * are uniform, so one or two byte passes leave buckets small enough for
+ * std::sort; long shared prefixes just take more passes.
+ */
+template<typename T>
+void RadixSortHashes(T* p, T* pTmp, size_t n, unsigned int nByte = 0)
+{
+	while (n > RADIX_SORT_CUTOFF && nByte < (unsigned int)CHashSortKey<T>::KEY_SIZE)
+	{
+		size_t vCount[256] = {0};
+		for (size_t i = 0; i < n; i++)
+			vCount[CHashSortKey<T>::Byte(p[i], nByte)]++;
+
+		// Everything shares this byte: nothing to scatter
+		if (vCount[CHashSortKey<T>::Byte(p[0], nByte)] == n)
+		{
+			nByte++;
+			continue;
+		}
+
+		size_t vPos[256];
+		size_t nPos = 0;
+		for (int b = 0; b < 256; b++)
+		{
+			vPos[b] = nPos;
+			nPos += vCount[b];
+		}
+
+		for (size_t i = 0; i < n; i++)
+			pTmp[vPos[CHashSortKey<T>::Byte(p[i], nByte)]++] = p[i];
+		std::copy(pTmp, pTmp + n, p);
+
+		size_t nStart = 0;
+		for (int b = 0; b < 256; nStart += vCount[b], b++)
+			if (vCount[b] > 1)
+				RadixSortHashes(p + nStart, pTmp + nStart, vCount[b], nByte + 1);
+		return;
+	}
+
+	std::sort(p, p + n);
+}
+
+template<typename T>
+void SortHashes(std::vector<T>& v)
+{
+	if (v.size() < 2)
+		return;
+
+	std::vector<T> vTmp(v.size());
+	RadixSortHashes(&v[0], &vTmp[0], v.size());
+}
+
+// Sort and drop duplicates
+template<typename T>
+void SortUniqueHashes(std::vector<T>& v)
+{
+	SortHashes(v);
+	v.erase(std::unique(v.begin(), v.end()), v.end());
+}
+
+/**
+ * Immutable sorted set of hashes, built once and then searched.
+ *
+ * Next to the elements it keeps their 8-byte prefixes, so searching touches
+ * a quarter of the memory a plain binary search over uint256s would and
+ * compares integers. Single lookups use interpolation search, which takes
+ * O(log log n) steps on uniformly distributed keys; batched lookups run
+ * several branch-free binary searches interleaved so their cache misses
+ * overlap.
+ */
+template<typename T>
+class CSortedHashSet
+{
+public:
+	typedef typename std::vector<T>::const_iterator const_iterator;
+
+	CSortedHashSet() {}
+
+	explicit CSortedHashSet(const std::vector<T>& v)
+	{
+		std::vector<T> vCopy(v);
+		Assign(vCopy);
+	}
+
+	// Take v's elements (v is left empty), sorting and deduplicating them
+	void Assign(std::vector<T>& v)
+	{
+		SortUniqueHashes(v);
+		vData.clear();
+		vData.swap(v);
+
+		vPrefix.resize(vData.size());
+		for (size_t i = 0; i < vData.size(); i++)
+			vPrefix[i] = CHashSortKey<T>::Prefix(vData[i]);
+	}
+
+	size_t size() const { return vData.size(); }
+	bool empty() const { return vData.empty(); }
+	const_iterator begin() const { return vData.begin(); }
+	const_iterator end() const { return vData.end(); }
+	const T& operator[](size_t i) const { return vData[i]; }
+
+	// Index of the first element not less than key
+	size_t lower_bound(const T& key) const
+	{
+		return Resolve(key, PrefixLowerBound(CHashSortKey<T>::Prefix(key)));
+	}
+
+	// lower_bound() of nKeys keys at once, into pOut
+	void lower_bound(const T* pKeys, size_t nKeys, size_t* pOut) const
+	{
+		const uint64_t* pPrefix = vPrefix.empty() ? NULL : &vPrefix[0];
+		size_t n = vPrefix.size();
+
+		for (size_t k = 0; k < nKeys; k += BATCH)
+		{
+			size_t nBatch = std::min((size_t)BATCH, nKeys - k);
+			uint64_t vKey[BATCH];
+			const uint64_t* vBase[BATCH];
+
+			for (size_t j = 0; j < nBatch; j++)
+			{
+				vKey[j] = CHashSortKey<T>::Prefix(pKeys[k + j]);
+				vBase[j] = pPrefix;
+			}
+
+			size_t nLen = n;
+			while (nLen > 1)
+			{
+				size_t nHalf = nLen / 2;
+				for (size_t j = 0; j < nBatch; j++)
+				{
+					// Both places the next step can look at
+					__builtin_prefetch(vBase[j] + nHalf / 2);
+					__builtin_prefetch(vBase[j] + nHalf + nHalf / 2);
+					vBase[j] = (vBase[j][nHalf - 1] < vKey[j]) ? vBase[j] + nHalf : vBase[j];
+				}
+				nLen -= nHalf;
+			}
+
+			for (size_t j = 0; j < nBatch; j++)
+			{
+				size_t i = (n == 0) ? 0 : vBase[j] - pPrefix + (*vBase[j] < vKey[j]);
+				pOut[k + j] = Resolve(pKeys[k + j], i);
+			}
+		}
+	}
+
+	bool contains(const T& key) const
+	{
+		size_t i = lower_bound(key);
+		return i < vData.size() && vData[i] == key;
+	}
+
+	size_t count(const T& key) const
+	{
+		return contains(key);
+	}
+
+	unsigned int GetSerializeSize(int nType=0, int nVersion=PROTOCOL_VERSION) const
+	{
+		return ::GetSerializeSize(vData, nType, nVersion);
+	}
+
+	template<typename Stream>
+	void Serialize(Stream& s, int nType=0, int nVersion=PROTOCOL_VERSION) const
+	{
+		::Serialize(s, vData, nType, nVersion);
+	}
+
+	template<typename Stream>
+	void Unserialize(Stream& s, int nType=0, int nVersion=PROTOCOL_VERSION)
+	{
+		std::vector<T> v;
+		::Unserialize(s, v, nType, nVersion);
+		Assign(v);
+	}
+
+private:
+	// Lookups searched side by side by the batched lower_bound
+	enum { BATCH = 8 };
+
+	// Interpolation steps before falling back to binary search, in case
+	// the keys are not as uniform as they should be
+	enum { MAX_INTERPOLATION_STEPS = 8 };
+
+	std::vector<T> vData;
+	std::vector<uint64_t> vPrefix;
+
+	// First index whose prefix is not less than nKey
+	size_t PrefixLowerBound(uint64_t nKey) const
+	{
+		// Invariant: prefixes before lo are < nKey, from hi on are >= nKey
+		size_t lo = 0;
+		size_t hi = vPrefix.size();
+
+		for (int nStep = 0; hi - lo > 32 && nStep < MAX_INTERPOLATION_STEPS; nStep++)
+		{
+			uint64_t nLo = vPrefix[lo];
+			uint64_t nHi = vPrefix[hi - 1];
+
+			if (nKey <= nLo)
+				return lo;
+			if (nKey > nHi)
+				return hi;
+
+			// nLo < nKey <= nHi, so the guess lands in [lo, hi - 1]
+			size_t nGuess = lo + (size_t)((double)(nKey - nLo) / (double)(nHi - nLo) * (hi - 1 - lo));
+			nGuess = std::min(std::max(nGuess, lo), hi - 1);
+
+			if (vPrefix[nGuess] < nKey)
+				lo = nGuess + 1;
+			else
+				hi = nGuess;
+		}
+
+		return std::lower_bound(vPrefix.begin() + lo, vPrefix.begin() + hi, nKey) - vPrefix.begin();
+	}
+
+	// From the first element with key's prefix or above, skip the ones that
+	// share the prefix but are still less than key
+	size_t Resolve(const T& key, size_t i) const
+	{
+		uint64_t nKey = CHashSortKey<T>::Prefix(key);
+
+		while (i < vData.size() && vPrefix[i] == nKey && vData[i] < key)
+			i++;
+
+		return i;
+	}
+};
+
+#endif // BITCOIN_SORTEDHASH_H
@@ -0,0 +1,259 @@
+#include "uint256.h"
+
+// Value of each hex digit character, -1 for anything else
+const signed char p_util_hexdigit[256] =
+{
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+// The two lowercase hex digits of every byte value
+const char p_util_hexpairs[513] =
+	"000102030405060708090a0b0c0d0e0f"
+	"101112131415161718191a1b1c1d1e1f"
+	"202122232425262728292a2b2c2d2e2f"
+	"303132333435363738393a3b3c3d3e3f"
+	"404142434445464748494a4b4c4d4e4f"
+	"505152535455565758595a5b5c5d5e5f"
+	"606162636465666768696a6b6c6d6e6f"
+	"707172737475767778797a7b7c7d7e7f"
+	"808182838485868788898a8b8c8d8e8f"
+	"909192939495969798999a9b9c9d9e9f"
+	"a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+	"b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+	"c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+	"d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+	"e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+	"f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+template<unsigned int BITS>
+base_uint<BITS>& base_uint<BITS>::operator*=(uint32_t b32)
+{
+	uint64_t carry = 0;
+
+	for (int i = 0; i < WIDTH; i++)
+	{
+		uint64_t n = carry + (uint64_t)b32 * pn[i];
+		pn[i] = n & 0xffffffff;
+		carry = n >> 32;
+	}
+
+	return *this;
+}
+
+template<unsigned int BITS>
+base_uint<BITS>& base_uint<BITS>::operator*=(const base_uint& b)
+{
+	// Schoolbook multiplication, keeping only the low BITS of the product
+	uint32_t a[WIDTH];
+	memcpy(a, pn, sizeof(a));
+	memset(pn, 0, sizeof(pn));
+
+	for (int j = 0; j < WIDTH; j++)
+	{
+		uint64_t carry = 0;
+
+		for (int i = 0; i + j < WIDTH; i++)
+		{
+			uint64_t n = carry + pn[i + j] + (uint64_t)a[j] * b.pn[i];
+			pn[i + j] = n & 0xffffffff;
+			carry = n >> 32;
+		}
+	}
+
+	return *this;
+}
+
+// Knuth's algorithm D on 32-bit digits: q = u / v, where u has m digits,
+// v has n digits, v[n-1] != 0 and m >= n (at most 16, i.e. 512 bits).
+// q receives m - n + 1 digits.
+static void DivideWords(const uint32_t* u, int m, const uint32_t* v, int n, uint32_t* q)
+{
+	if (n == 1)
+	{
+		// Short division
+		uint64_t rem = 0;
+
+		for (int j = m - 1; j >= 0; j--)
+		{
+			uint64_t num = (rem << 32) | u[j];
+			q[j] = (uint32_t)(num / v[0]);
+			rem = num % v[0];
+		}
+
+		return;
+	}
+
+	// Normalize so that the top digit of the divisor has its high bit set;
+	// un gets an extra digit for the bits shifted out of u
+	uint32_t vn[16];
+	uint32_t un[17];
+	int s = __builtin_clz(v[n - 1]);
+
+	for (int i = n - 1; i > 0; i--)
+	{
+		vn[i] = (v[i] << s) | (s ? (uint32_t)((uint64_t)v[i - 1] >> (32 - s)) : 0);
+	}
+	vn[0] = v[0] << s;
+
+	un[m] = s ? (uint32_t)((uint64_t)u[m - 1] >> (32 - s)) : 0;
+	for (int i = m - 1; i > 0; i--)
+	{
+		un[i] = (u[i] << s) | (s ? (uint32_t)((uint64_t)u[i - 1] >> (32 - s)) : 0);
+	}
+	un[0] = u[0] << s;
+
+	for (int j = m - n; j >= 0; j--)
+	{
+		// Estimate the quotient digit from the top two digits, then correct
+		// it so that it is at most one too large
+		uint64_t num = ((uint64_t)un[j + n] << 32) | un[j + n - 1];
+		uint64_t qhat = num / vn[n - 1];
+		uint64_t rhat = num % vn[n - 1];
+
+		while (qhat > 0xffffffff || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2]))
+		{
+			qhat--;
+			rhat += vn[n - 1];
+			if (rhat > 0xffffffff)
+			{
+				break;
+			}
+		}
+
+		// Multiply and subtract
+		int64_t borrow = 0;
+		int64_t t;
+
+		for (int i = 0; i < n; i++)
+		{
+			uint64_t p = qhat * vn[i];
+			t = (int64_t)un[i + j] - borrow - (int64_t)(p & 0xffffffff);
+			un[i + j] = (uint32_t)t;
+			borrow = (int64_t)(p >> 32) - (t >> 32);
+		}
+
+		t = (int64_t)un[j + n] - borrow;
+		un[j + n] = (uint32_t)t;
+		q[j] = (uint32_t)qhat;
+
+		if (t < 0)
+		{
+			// Subtracted one time too many; add the divisor back
+			q[j]--;
+			uint64_t carry = 0;
+
+			for (int i = 0; i < n; i++)
+			{
+				uint64_t sum = (uint64_t)un[i + j] + vn[i] + carry;
+				un[i + j] = (uint32_t)sum;
+				carry = sum >> 32;
+			}
+
+			un[j + n] += (uint32_t)carry;
+		}
+	}
+}
+
+template<unsigned int BITS>
+base_uint<BITS>& base_uint<BITS>::operator/=(const base_uint& b)
+{
+	int nNumWords = (bits() + 31) / 32;
+	int nDivWords = (b.bits() + 31) / 32;
+
+	if (nDivWords == 0)
+	{
+		throw uint_error("base_uint::operator/= : division by zero");
+	}
+
+	uint32_t num[WIDTH];
+	memcpy(num, pn, sizeof(num));
+	memset(pn, 0, sizeof(pn));
+
+	if (nDivWords > nNumWords)
+	{
+		// the quotient is 0
+		return *this;
+	}
+
+	DivideWords(num, nNumWords, b.pn, nDivWords, pn);
+
+	return *this;
+}
+
+template class base_uint<160>;
+template class base_uint<256>;
+
+uint256& uint256::SetCompact(uint32_t nCompact, bool* pfNegative, bool* pfOverflow)
+{
+	int nSize = nCompact >> 24;
+	uint32_t nWord = nCompact & 0x007fffff;
+
+	if (nSize <= 3)
+	{
+		nWord >>= 8 * (3 - nSize);
+		*this = nWord;
+	}
+	else
+	{
+		*this = nWord;
+		*this <<= 8 * (nSize - 3);
+	}
+
+	if (pfNegative)
+	{
+		*pfNegative = nWord != 0 && (nCompact & 0x00800000) != 0;
+	}
+
+	if (pfOverflow)
+	{
+		*pfOverflow = nWord != 0 && ((nSize > 34) ||
+		                             (nWord > 0xff && nSize > 33) ||
+		                             (nWord > 0xffff && nSize > 32));
+	}
+
+	return *this;
+}
+
+uint32_t uint256::GetCompact(bool fNegative) const
+{
+	int nSize = (bits() + 7) / 8;
+	uint32_t nCompact = 0;
+
+	if (nSize <= 3)
+	{
+		nCompact = GetLow64() << 8 * (3 - nSize);
+	}
+	else
+	{
+		uint256 bn = *this >> 8 * (nSize - 3);
+		nCompact = bn.GetLow64();
+	}
+
+	// The 0x00800000 bit denotes the sign.
+	// Thus, if it is already set, divide the mantissa by 256 and increase the exponent.
+	if (nCompact & 0x00800000)
+	{
+		nCompact >>= 8;
+		nSize++;
+	}
+
+	nCompact |= nSize << 24;
+	nCompact |= (fNegative && (nCompact & 0x007fffff) ? 0x00800000 : 0);
+
+	return nCompact;
+}
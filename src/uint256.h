@@ -6,25 +6,64 @@
 #ifndef BITCOIN_UINT256_H
 #define BITCOIN_UINT256_H
 
+#include <assert.h>
+#include <stdexcept>
 #include <stdint.h>
 #include <stdio.h>
 #include <string>
 #include <string.h>
 #include <ctype.h>
+#include <utility>
 #include <vector>
+#if defined(__x86_64__)
+#include <immintrin.h> // for _addcarry_u64(), _subborrow_u64()
+#endif
+
+/** Errors thrown by base_uint arithmetic */
+class uint_error : public std::runtime_error
+{
+public:
+	explicit uint_error(const std::string& str)
+		: std::runtime_error(str)
+	{
+		// nothing
+	}
+};
+
+extern const signed char p_util_hexdigit[256];
+extern const char p_util_hexpairs[513];
 
 inline signed char HexDigit(char c)
 {
-	char lower = tolower(c);
+	return p_util_hexdigit[(unsigned char)c];
+}
 
-	if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))
-		return c - '0';
-	else
-		return -1;
+// Whether code is being evaluated as a constant expression (GCC 9, Clang 9).
+// Without it comparisons always take their constexpr path, which is correct
+// but branches on the data
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define UINT_IS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+#elif defined(__GNUC__) && __GNUC__ >= 9
+#define UINT_IS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+#ifndef UINT_IS_CONSTANT_EVALUATED
+#define UINT_IS_CONSTANT_EVALUATED() true
+#endif
+
+// HexDigit() usable in constant expressions; anything but a hex digit is an
+// error, at compile time if that is when it is evaluated
+constexpr signed char ConstHexDigit(char c)
+{
+	return (c >= '0' && c <= '9') ? c - '0' :
+	       (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+	       (c >= 'A' && c <= 'F') ? c - 'A' + 10 :
+	       throw uint_error("ConstHexDigit : not a hex digit");
 }
 
-/** Base class without constructors for uint256 and uint160.
- * This makes the compiler let you use it in a union.
+/** Base class for uint256 and uint160. The default constructor stays
+ * trivial, which makes the compiler let you use it in a union.
  */
 template<unsigned int BITS>
 class base_uint
@@ -32,14 +71,132 @@ class base_uint
 protected:
     enum { WIDTH=BITS/32 };
     uint32_t pn[WIDTH];
+
+    // Arithmetic works on 64-bit limbs over the same storage: limb i is
+    // pn[2*i] | pn[2*i+1] << 32. When WIDTH is odd (uint160) the last limb
+    // reads as zero-extended and stores only its low 32 bits, so results
+    // wrap modulo 2^BITS exactly as before.
+    enum { LIMBS=(WIDTH+1)/2 };
+
+    base_uint() = default;
+
+    // From exactly BITS/4 hex digits, most significant first; word I takes
+    // the digits psz[BITS/4 - 8*(I+1)] to psz[BITS/4 - 8*I - 1]
+    template<size_t... I>
+    constexpr base_uint(const char* psz, std::index_sequence<I...>) : pn{HexWord(psz, I)...}
+    {
+    }
+
+    static constexpr uint32_t HexWord(const char* psz, size_t i)
+    {
+        uint32_t n = 0;
+        for (size_t j = BITS/4 - 8*(i+1); j < BITS/4 - 8*i; j++)
+            n = n << 4 | ConstHexDigit(psz[j]);
+        return n;
+    }
+
+    // Comparison of the 32-bit words, most significant first, for constant
+    // expressions where the limb code below (memcpy, intrinsics) cannot run
+    static constexpr int CompareWords(const base_uint& a, const base_uint& b)
+    {
+        for (int i = WIDTH-1; i >= 0; i--)
+        {
+            if (a.pn[i] != b.pn[i])
+                return a.pn[i] < b.pn[i] ? -1 : 1;
+        }
+        return 0;
+    }
+
+    uint64_t GetLimb(int i) const
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        if (2*i+1 < WIDTH)
+        {
+            // single 64-bit load
+            uint64_t n;
+            memcpy(&n, &pn[2*i], sizeof(n));
+            return n;
+        }
+#endif
+        return pn[2*i] | (2*i+1 < WIDTH ? (uint64_t)pn[2*i+1] << 32 : 0);
+    }
+
+    void SetLimb(int i, uint64_t n)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        if (2*i+1 < WIDTH)
+        {
+            memcpy(&pn[2*i], &n, sizeof(n));
+            return;
+        }
+#endif
+        pn[2*i] = (uint32_t)n;
+        if (2*i+1 < WIDTH)
+            pn[2*i+1] = (uint32_t)(n >> 32);
+    }
+
+    // a + b + carry and a - b - borrow, returning the carry/borrow out;
+    // x86-64 chains them through the flags with adc/sbb
+    static unsigned char AddCarry(unsigned char carry, uint64_t a, uint64_t b, uint64_t* pn)
+    {
+#if defined(__x86_64__)
+        unsigned long long n;
+        carry = _addcarry_u64(carry, a, b, &n);
+        *pn = n;
+        return carry;
+#else
+        uint64_t n;
+        unsigned char c1 = __builtin_add_overflow(a, b, &n);
+        unsigned char c2 = __builtin_add_overflow(n, (uint64_t)carry, pn);
+        return c1 | c2;
+#endif
+    }
+
+    static unsigned char SubBorrow(unsigned char borrow, uint64_t a, uint64_t b, uint64_t* pn)
+    {
+#if defined(__x86_64__)
+        unsigned long long n;
+        borrow = _subborrow_u64(borrow, a, b, &n);
+        *pn = n;
+        return borrow;
+#else
+        uint64_t n;
+        unsigned char b1 = __builtin_sub_overflow(a, b, &n);
+        unsigned char b2 = __builtin_sub_overflow(n, (uint64_t)borrow, pn);
+        return b1 | b2;
+#endif
+    }
+
+    // Borrow out of a - b, i.e. a < b, without data-dependent branches
+    static constexpr bool LessThan(const base_uint& a, const base_uint& b)
+    {
+        if (UINT_IS_CONSTANT_EVALUATED())
+            return CompareWords(a, b) < 0;
+        unsigned char borrow = 0;
+        uint64_t n = 0;
+        for (int i = 0; i < LIMBS; i++)
+            borrow = SubBorrow(borrow, a.GetLimb(i), b.GetLimb(i), &n);
+        return borrow;
+    }
+
+    static constexpr bool Equal(const base_uint& a, const base_uint& b)
+    {
+        if (UINT_IS_CONSTANT_EVALUATED())
+            return CompareWords(a, b) == 0;
+        uint64_t diff = 0;
+        for (int i = 0; i < LIMBS; i++)
+            diff |= a.GetLimb(i) ^ b.GetLimb(i);
+        return diff == 0;
+    }
+
 public:
 
     bool operator!() const
     {
-        for (int i = 0; i < WIDTH; i++)
-            if (pn[i] != 0)
-                return false;
-        return true;
+        uint64_t bits = 0;
+        for (int i = 0; i < LIMBS; i++)
+            bits |= GetLimb(i);
+        return bits == 0;
     }
 
     const base_uint operator~() const
@@ -72,10 +229,9 @@ public:
 
     base_uint& operator=(uint64_t b)
     {
-        pn[0] = (unsigned int)b;
-        pn[1] = (unsigned int)(b >> 32);
-        for (int i = 2; i < WIDTH; i++)
-            pn[i] = 0;
+        SetLimb(0, b);
+        for (int i = 1; i < LIMBS; i++)
+            SetLimb(i, 0);
         return *this;
     }
 
@@ -117,16 +273,16 @@ public:
     base_uint& operator<<=(unsigned int shift)
     {
         base_uint a(*this);
-        for (int i = 0; i < WIDTH; i++)
-            pn[i] = 0;
-        int k = shift / 32;
-        shift = shift % 32;
-        for (int i = 0; i < WIDTH; i++)
+        int k = shift / 64;
+        shift = shift % 64;
+        for (int i = LIMBS-1; i >= 0; i--)
         {
-            if (i+k+1 < WIDTH && shift != 0)
-                pn[i+k+1] |= (a.pn[i] >> (32-shift));
-            if (i+k < WIDTH)
-                pn[i+k] |= (a.pn[i] << shift);
+            uint64_t n = 0;
+            if (i-k >= 0)
+                n = a.GetLimb(i-k) << shift;
+            if (i-k-1 >= 0 && shift != 0)
+                n |= a.GetLimb(i-k-1) >> (64-shift);
+            SetLimb(i, n);
         }
         return *this;
     }
@@ -134,61 +290,81 @@ public:
     base_uint& operator>>=(unsigned int shift)
     {
         base_uint a(*this);
-        for (int i = 0; i < WIDTH; i++)
-            pn[i] = 0;
-        int k = shift / 32;
-        shift = shift % 32;
-        for (int i = 0; i < WIDTH; i++)
+        int k = shift / 64;
+        shift = shift % 64;
+        for (int i = 0; i < LIMBS; i++)
         {
-            if (i-k-1 >= 0 && shift != 0)
-                pn[i-k-1] |= (a.pn[i] << (32-shift));
-            if (i-k >= 0)
-                pn[i-k] |= (a.pn[i] >> shift);
+            uint64_t n = 0;
+            if (i+k < LIMBS)
+                n = a.GetLimb(i+k) >> shift;
+            if (i+k+1 < LIMBS && shift != 0)
+                n |= a.GetLimb(i+k+1) << (64-shift);
+            SetLimb(i, n);
         }
         return *this;
     }
 
     base_uint& operator+=(const base_uint& b)
     {
-        uint64_t carry = 0;
-        for (int i = 0; i < WIDTH; i++)
+        unsigned char carry = 0;
+        for (int i = 0; i < LIMBS; i++)
         {
-            uint64_t n = carry + pn[i] + b.pn[i];
-            pn[i] = n & 0xffffffff;
-            carry = n >> 32;
+            uint64_t n;
+            carry = AddCarry(carry, GetLimb(i), b.GetLimb(i), &n);
+            SetLimb(i, n);
         }
         return *this;
     }
 
     base_uint& operator-=(const base_uint& b)
     {
-        *this += -b;
+        unsigned char borrow = 0;
+        for (int i = 0; i < LIMBS; i++)
+        {
+            uint64_t n;
+            borrow = SubBorrow(borrow, GetLimb(i), b.GetLimb(i), &n);
+            SetLimb(i, n);
+        }
         return *this;
     }
 
     base_uint& operator+=(uint64_t b64)
     {
-        base_uint b;
-        b = b64;
-        *this += b;
+        uint64_t n;
+        unsigned char carry = AddCarry(0, GetLimb(0), b64, &n);
+        SetLimb(0, n);
+        for (int i = 1; i < LIMBS && carry; i++)
+        {
+            carry = AddCarry(carry, GetLimb(i), 0, &n);
+            SetLimb(i, n);
+        }
         return *this;
     }
 
     base_uint& operator-=(uint64_t b64)
     {
-        base_uint b;
-        b = b64;
-        *this += -b;
+        uint64_t n;
+        unsigned char borrow = SubBorrow(0, GetLimb(0), b64, &n);
+        SetLimb(0, n);
+        for (int i = 1; i < LIMBS && borrow; i++)
+        {
+            borrow = SubBorrow(borrow, GetLimb(i), 0, &n);
+            SetLimb(i, n);
+        }
         return *this;
     }
 
 
+    // Products and quotients are computed in place, modulo 2^BITS;
+    // dividing by zero throws uint_error
+    base_uint& operator*=(uint32_t b32);
+    base_uint& operator*=(const base_uint& b);
+    base_uint& operator/=(const base_uint& b);
+
     base_uint& operator++()
     {
         // prefix operator
-        int i = 0;
-        while (++pn[i] == 0 && i < WIDTH-1)
-            i++;
+        *this += 1;
         return *this;
     }
 
@@ -203,9 +379,7 @@ public:
     base_uint& operator--()
     {
         // prefix operator
-        int i = 0;
-        while (--pn[i] == (uint32_t)-1 && i < WIDTH-1)
-            i++;
+        *this -= 1;
         return *this;
     }
 
@@ -218,91 +392,74 @@ public:
     }
 
 
-    friend inline bool operator<(const base_uint& a, const base_uint& b)
+    friend constexpr bool operator<(const base_uint& a, const base_uint& b)
     {
-        for (int i = base_uint::WIDTH-1; i >= 0; i--)
-        {
-            if (a.pn[i] < b.pn[i])
-                return true;
-            else if (a.pn[i] > b.pn[i])
-                return false;
-        }
-        return false;
+        return LessThan(a, b);
     }
 
-    friend inline bool operator<=(const base_uint& a, const base_uint& b)
+    friend constexpr bool operator<=(const base_uint& a, const base_uint& b)
     {
-        for (int i = base_uint::WIDTH-1; i >= 0; i--)
-        {
-            if (a.pn[i] < b.pn[i])
-                return true;
-            else if (a.pn[i] > b.pn[i])
-                return false;
-        }
-        return true;
+        return !LessThan(b, a);
     }
 
-    friend inline bool operator>(const base_uint& a, const base_uint& b)
+    friend constexpr bool operator>(const base_uint& a, const base_uint& b)
     {
-        for (int i = base_uint::WIDTH-1; i >= 0; i--)
-        {
-            if (a.pn[i] > b.pn[i])
-                return true;
-            else if (a.pn[i] < b.pn[i])
-                return false;
-        }
-        return false;
+        return LessThan(b, a);
     }
 
-    friend inline bool operator>=(const base_uint& a, const base_uint& b)
+    friend constexpr bool operator>=(const base_uint& a, const base_uint& b)
     {
-        for (int i = base_uint::WIDTH-1; i >= 0; i--)
-        {
-            if (a.pn[i] > b.pn[i])
-                return true;
-            else if (a.pn[i] < b.pn[i])
-                return false;
-        }
-        return true;
+        return !LessThan(a, b);
     }
 
-    friend inline bool operator==(const base_uint& a, const base_uint& b)
+    friend constexpr bool operator==(const base_uint& a, const base_uint& b)
     {
-        for (int i = 0; i < base_uint::WIDTH; i++)
-            if (a.pn[i] != b.pn[i])
-                return false;
-        return true;
+        return Equal(a, b);
     }
 
-    friend inline bool operator==(const base_uint& a, uint64_t b)
+    friend constexpr bool operator==(const base_uint& a, uint64_t b)
     {
-        if (a.pn[0] != (unsigned int)b)
-            return false;
-        if (a.pn[1] != (unsigned int)(b >> 32))
-            return false;
-        for (int i = 2; i < base_uint::WIDTH; i++)
-            if (a.pn[i] != 0)
-                return false;
-        return true;
+        if (UINT_IS_CONSTANT_EVALUATED())
+        {
+            uint32_t diff = (a.pn[0] ^ (uint32_t)b) | (a.pn[1] ^ (uint32_t)(b >> 32));
+            for (int i = 2; i < WIDTH; i++)
+                diff |= a.pn[i];
+            return diff == 0;
+        }
+        uint64_t diff = a.GetLimb(0) ^ b;
+        for (int i = 1; i < base_uint::LIMBS; i++)
+            diff |= a.GetLimb(i);
+        return diff == 0;
     }
 
-    friend inline bool operator!=(const base_uint& a, const base_uint& b)
+    friend constexpr bool operator!=(const base_uint& a, const base_uint& b)
     {
         return (!(a == b));
     }
 
-    friend inline bool operator!=(const base_uint& a, uint64_t b)
+    friend constexpr bool operator!=(const base_uint& a, uint64_t b)
     {
         return (!(a == b));
     }
 
 
 
+    // Length of GetHex() output, without the terminating NUL
+    enum { HEX_SIZE=BITS/4 };
+
+    // Write HEX_SIZE hex digits and a NUL into psz, without allocating
+    void GetHex(char* psz) const
+    {
+        const unsigned char* p = (const unsigned char*)pn;
+        for (unsigned int i = 0; i < sizeof(pn); i++)
+            memcpy(psz + i*2, &p_util_hexpairs[p[sizeof(pn) - i - 1] * 2], 2);
+        psz[sizeof(pn)*2] = 0;
+    }
+
     std::string GetHex() const
     {
         char psz[sizeof(pn)*2 + 1];
-        for (unsigned int i = 0; i < sizeof(pn); i++)
-            sprintf(psz + i*2, "%02x", ((unsigned char*)pn)[sizeof(pn) - i - 1]);
+        GetHex(psz);
         return std::string(psz, psz + sizeof(pn)*2);
     }
 
@@ -322,18 +479,15 @@ public:
         const char* pbegin = psz;
         while (::HexDigit(*psz) != -1)
             psz++;
-        psz--;
         unsigned char* p1 = (unsigned char*)pn;
         unsigned char* pend = p1 + WIDTH * 4;
-        while (psz >= pbegin && p1 < pend)
+        while (psz - pbegin >= 2 && p1 < pend)
         {
-            *p1 = ::HexDigit(*psz--);
-            if (psz >= pbegin)
-            {
-                *p1 |= ((unsigned char)::HexDigit(*psz--) << 4);
-                p1++;
-            }
+            psz -= 2;
+            *p1++ = (::HexDigit(psz[0]) << 4) | ::HexDigit(psz[1]);
         }
+        if (psz > pbegin && p1 < pend)
+            *p1 = ::HexDigit(psz[-1]);
     }
 
     void SetHex(const std::string& str)
@@ -371,6 +525,18 @@ public:
         return sizeof(pn);
     }
 
+    // Position of the highest set bit plus one, 0 for zero
+    unsigned int bits() const
+    {
+        for (int i = LIMBS-1; i >= 0; i--)
+        {
+            uint64_t n = GetLimb(i);
+            if (n != 0)
+                return 64*i + 64 - __builtin_clzll(n);
+        }
+        return 0;
+    }
+
     uint64_t GetLow64() const
     {
         assert(WIDTH >= 2);
@@ -422,6 +588,14 @@ typedef base_uint<256> base_uint256;
 /** 160-bit unsigned integer */
 class uint160 : public base_uint160
 {
+    // From exactly 40 hex digits; only for operator""_uint160
+    template<size_t... I>
+    constexpr uint160(const char* psz, std::index_sequence<I...> seq) : base_uint160(psz, seq)
+    {
+    }
+
+    friend constexpr uint160 operator""_uint160(const char* psz, size_t n);
+
 public:
     typedef base_uint160 basetype;
 
@@ -475,8 +649,8 @@ public:
     }
 };
 
-inline bool operator==(const uint160& a, uint64_t b)                         { return (base_uint160)a == b; }
-inline bool operator!=(const uint160& a, uint64_t b)                         { return (base_uint160)a != b; }
+constexpr bool operator==(const uint160& a, uint64_t b)                      { return (const base_uint160&)a == b; }
+constexpr bool operator!=(const uint160& a, uint64_t b)                      { return (const base_uint160&)a != b; }
 inline const uint160 operator<<(const base_uint160& a, unsigned int shift)   { return uint160(a) <<= shift; }
 inline const uint160 operator>>(const base_uint160& a, unsigned int shift)   { return uint160(a) >>= shift; }
 inline const uint160 operator<<(const uint160& a, unsigned int shift)        { return uint160(a) <<= shift; }
@@ -487,42 +661,62 @@ inline const uint160 operator&(const base_uint160& a, const base_uint160& b) { r
 inline const uint160 operator|(const base_uint160& a, const base_uint160& b) { return uint160(a) |= b; }
 inline const uint160 operator+(const base_uint160& a, const base_uint160& b) { return uint160(a) += b; }
 inline const uint160 operator-(const base_uint160& a, const base_uint160& b) { return uint160(a) -= b; }
-
-inline bool operator<(const base_uint160& a, const uint160& b)               { return (base_uint160)a <  (base_uint160)b; }
-inline bool operator<=(const base_uint160& a, const uint160& b)              { return (base_uint160)a <= (base_uint160)b; }
-inline bool operator>(const base_uint160& a, const uint160& b)               { return (base_uint160)a >  (base_uint160)b; }
-inline bool operator>=(const base_uint160& a, const uint160& b)              { return (base_uint160)a >= (base_uint160)b; }
-inline bool operator==(const base_uint160& a, const uint160& b)              { return (base_uint160)a == (base_uint160)b; }
-inline bool operator!=(const base_uint160& a, const uint160& b)              { return (base_uint160)a != (base_uint160)b; }
+inline const uint160 operator*(const base_uint160& a, const base_uint160& b) { return uint160(a) *= b; }
+inline const uint160 operator/(const base_uint160& a, const base_uint160& b) { return uint160(a) /= b; }
+inline const uint160 operator*(const base_uint160& a, uint32_t b)            { return uint160(a) *= b; }
+
+constexpr bool operator<(const base_uint160& a, const uint160& b)            { return (const base_uint160&)a <  (const base_uint160&)b; }
+constexpr bool operator<=(const base_uint160& a, const uint160& b)           { return (const base_uint160&)a <= (const base_uint160&)b; }
+constexpr bool operator>(const base_uint160& a, const uint160& b)            { return (const base_uint160&)a >  (const base_uint160&)b; }
+constexpr bool operator>=(const base_uint160& a, const uint160& b)           { return (const base_uint160&)a >= (const base_uint160&)b; }
+constexpr bool operator==(const base_uint160& a, const uint160& b)           { return (const base_uint160&)a == (const base_uint160&)b; }
+constexpr bool operator!=(const base_uint160& a, const uint160& b)           { return (const base_uint160&)a != (const base_uint160&)b; }
 inline const uint160 operator^(const base_uint160& a, const uint160& b)      { return (base_uint160)a ^  (base_uint160)b; }
 inline const uint160 operator&(const base_uint160& a, const uint160& b)      { return (base_uint160)a &  (base_uint160)b; }
 inline const uint160 operator|(const base_uint160& a, const uint160& b)      { return (base_uint160)a |  (base_uint160)b; }
 inline const uint160 operator+(const base_uint160& a, const uint160& b)      { return (base_uint160)a +  (base_uint160)b; }
 inline const uint160 operator-(const base_uint160& a, const uint160& b)      { return (base_uint160)a -  (base_uint160)b; }
-
-inline bool operator<(const uint160& a, const base_uint160& b)               { return (base_uint160)a <  (base_uint160)b; }
-inline bool operator<=(const uint160& a, const base_uint160& b)              { return (base_uint160)a <= (base_uint160)b; }
-inline bool operator>(const uint160& a, const base_uint160& b)               { return (base_uint160)a >  (base_uint160)b; }
-inline bool operator>=(const uint160& a, const base_uint160& b)              { return (base_uint160)a >= (base_uint160)b; }
-inline bool operator==(const uint160& a, const base_uint160& b)              { return (base_uint160)a == (base_uint160)b; }
-inline bool operator!=(const uint160& a, const base_uint160& b)              { return (base_uint160)a != (base_uint160)b; }
+inline const uint160 operator*(const base_uint160& a, const uint160& b)      { return (base_uint160)a *  (base_uint160)b; }
+inline const uint160 operator/(const base_uint160& a, const uint160& b)      { return (base_uint160)a /  (base_uint160)b; }
+
+constexpr bool operator<(const uint160& a, const base_uint160& b)            { return (const base_uint160&)a <  (const base_uint160&)b; }
+constexpr bool operator<=(const uint160& a, const base_uint160& b)           { return (const base_uint160&)a <= (const base_uint160&)b; }
+constexpr bool operator>(const uint160& a, const base_uint160& b)            { return (const base_uint160&)a >  (const base_uint160&)b; }
+constexpr bool operator>=(const uint160& a, const base_uint160& b)           { return (const base_uint160&)a >= (const base_uint160&)b; }
+constexpr bool operator==(const uint160& a, const base_uint160& b)           { return (const base_uint160&)a == (const base_uint160&)b; }
+constexpr bool operator!=(const uint160& a, const base_uint160& b)           { return (const base_uint160&)a != (const base_uint160&)b; }
 inline const uint160 operator^(const uint160& a, const base_uint160& b)      { return (base_uint160)a ^  (base_uint160)b; }
 inline const uint160 operator&(const uint160& a, const base_uint160& b)      { return (base_uint160)a &  (base_uint160)b; }
 inline const uint160 operator|(const uint160& a, const base_uint160& b)      { return (base_uint160)a |  (base_uint160)b; }
 inline const uint160 operator+(const uint160& a, const base_uint160& b)      { return (base_uint160)a +  (base_uint160)b; }
 inline const uint160 operator-(const uint160& a, const base_uint160& b)      { return (base_uint160)a -  (base_uint160)b; }
-
-inline bool operator<(const uint160& a, const uint160& b)                    { return (base_uint160)a <  (base_uint160)b; }
-inline bool operator<=(const uint160& a, const uint160& b)                   { return (base_uint160)a <= (base_uint160)b; }
-inline bool operator>(const uint160& a, const uint160& b)                    { return (base_uint160)a >  (base_uint160)b; }
-inline bool operator>=(const uint160& a, const uint160& b)                   { return (base_uint160)a >= (base_uint160)b; }
-inline bool operator==(const uint160& a, const uint160& b)                   { return (base_uint160)a == (base_uint160)b; }
-inline bool operator!=(const uint160& a, const uint160& b)                   { return (base_uint160)a != (base_uint160)b; }
+inline const uint160 operator*(const uint160& a, const base_uint160& b)      { return (base_uint160)a *  (base_uint160)b; }
+inline const uint160 operator/(const uint160& a, const base_uint160& b)      { return (base_uint160)a /  (base_uint160)b; }
+
+constexpr bool operator<(const uint160& a, const uint160& b)                 { return (const base_uint160&)a <  (const base_uint160&)b; }
+constexpr bool operator<=(const uint160& a, const uint160& b)                { return (const base_uint160&)a <= (const base_uint160&)b; }
+constexpr bool operator>(const uint160& a, const uint160& b)                 { return (const base_uint160&)a >  (const base_uint160&)b; }
+constexpr bool operator>=(const uint160& a, const uint160& b)                { return (const base_uint160&)a >= (const base_uint160&)b; }
+constexpr bool operator==(const uint160& a, const uint160& b)                { return (const base_uint160&)a == (const base_uint160&)b; }
+constexpr bool operator!=(const uint160& a, const uint160& b)                { return (const base_uint160&)a != (const base_uint160&)b; }
 inline const uint160 operator^(const uint160& a, const uint160& b)           { return (base_uint160)a ^  (base_uint160)b; }
 inline const uint160 operator&(const uint160& a, const uint160& b)           { return (base_uint160)a &  (base_uint160)b; }
 inline const uint160 operator|(const uint160& a, const uint160& b)           { return (base_uint160)a |  (base_uint160)b; }
 inline const uint160 operator+(const uint160& a, const uint160& b)           { return (base_uint160)a +  (base_uint160)b; }
 inline const uint160 operator-(const uint160& a, const uint160& b)           { return (base_uint160)a -  (base_uint160)b; }
+inline const uint160 operator*(const uint160& a, const uint160& b)           { return (base_uint160)a *  (base_uint160)b; }
+inline const uint160 operator/(const uint160& a, const uint160& b)           { return (base_uint160)a /  (base_uint160)b; }
+inline const uint160 operator*(const uint160& a, uint32_t b)                 { return (base_uint160)a *  b; }
+
+// Exactly 40 hex digits, most significant first, with no "0x". Being
+// constexpr, a literal is parsed by the compiler and a bad one fails the build:
+//   static constexpr uint160 hash = "..."_uint160;
+// Strings known only at run time go through the std::string constructor
+constexpr uint160 operator""_uint160(const char* psz, size_t n)
+{
+    return n == 40 ? uint160(psz, std::make_index_sequence<5>()) :
+           throw uint_error("operator\"\"_uint160 : not 40 hex digits");
+}
 
 
 
@@ -534,6 +728,14 @@ inline const uint160 operator-(const uint160& a, const uint160& b)           { r
 /** 256-bit unsigned integer */
 class uint256 : public base_uint256
 {
+    // From exactly 64 hex digits; only for operator""_uint256
+    template<size_t... I>
+    constexpr uint256(const char* psz, std::index_sequence<I...> seq) : base_uint256(psz, seq)
+    {
+    }
+
+    friend constexpr uint256 operator""_uint256(const char* psz, size_t n);
+
 public:
     typedef base_uint256 basetype;
 
@@ -585,10 +787,20 @@ public:
         else
             *this = 0;
     }
+
+    /**
+     * The "compact" format is a representation of a whole number N using an
+     * unsigned 32bit number similar to a floating point format, as in
+     * CBigNum::SetCompact(): N = (-1^sign) * mantissa * 256^(exponent-3).
+     * A uint256 cannot be negative, so a set sign bit and values too large
+     * for 256 bits are reported through pfNegative and pfOverflow instead.
+     */
+    uint256& SetCompact(uint32_t nCompact, bool* pfNegative = NULL, bool* pfOverflow = NULL);
+    uint32_t GetCompact(bool fNegative = false) const;
 };
 
-inline bool operator==(const uint256& a, uint64_t b)                          { return (base_uint256)a == b; }
-inline bool operator!=(const uint256& a, uint64_t b)                          { return (base_uint256)a != b; }
+constexpr bool operator==(const uint256& a, uint64_t b)                       { return (const base_uint256&)a == b; }
+constexpr bool operator!=(const uint256& a, uint64_t b)                       { return (const base_uint256&)a != b; }
 inline const uint256 operator<<(const base_uint256& a, unsigned int shift)   { return uint256(a) <<= shift; }
 inline const uint256 operator>>(const base_uint256& a, unsigned int shift)   { return uint256(a) >>= shift; }
 inline const uint256 operator<<(const uint256& a, unsigned int shift)        { return uint256(a) <<= shift; }
@@ -599,41 +811,77 @@ inline const uint256 operator&(const base_uint256& a, const base_uint256& b) { r
 inline const uint256 operator|(const base_uint256& a, const base_uint256& b) { return uint256(a) |= b; }
 inline const uint256 operator+(const base_uint256& a, const base_uint256& b) { return uint256(a) += b; }
 inline const uint256 operator-(const base_uint256& a, const base_uint256& b) { return uint256(a) -= b; }
-
-inline bool operator<(const base_uint256& a, const uint256& b)          { return (base_uint256)a <  (base_uint256)b; }
-inline bool operator<=(const base_uint256& a, const uint256& b)         { return (base_uint256)a <= (base_uint256)b; }
-inline bool operator>(const base_uint256& a, const uint256& b)          { return (base_uint256)a >  (base_uint256)b; }
-inline bool operator>=(const base_uint256& a, const uint256& b)         { return (base_uint256)a >= (base_uint256)b; }
-inline bool operator==(const base_uint256& a, const uint256& b)         { return (base_uint256)a == (base_uint256)b; }
-inline bool operator!=(const base_uint256& a, const uint256& b)         { return (base_uint256)a != (base_uint256)b; }
+inline const uint256 operator*(const base_uint256& a, const base_uint256& b) { return uint256(a) *= b; }
+inline const uint256 operator/(const base_uint256& a, const base_uint256& b) { return uint256(a) /= b; }
+inline const uint256 operator*(const base_uint256& a, uint32_t b)            { return uint256(a) *= b; }
+
+constexpr bool operator<(const base_uint256& a, const uint256& b)       { return (const base_uint256&)a <  (const base_uint256&)b; }
+constexpr bool operator<=(const base_uint256& a, const uint256& b)      { return (const base_uint256&)a <= (const base_uint256&)b; }
+constexpr bool operator>(const base_uint256& a, const uint256& b)       { return (const base_uint256&)a >  (const base_uint256&)b; }
+constexpr bool operator>=(const base_uint256& a, const uint256& b)      { return (const base_uint256&)a >= (const base_uint256&)b; }
+constexpr bool operator==(const base_uint256& a, const uint256& b)      { return (const base_uint256&)a == (const base_uint256&)b; }
+constexpr bool operator!=(const base_uint256& a, const uint256& b)      { return (const base_uint256&)a != (const base_uint256&)b; }
 inline const uint256 operator^(const base_uint256& a, const uint256& b) { return (base_uint256)a ^  (base_uint256)b; }
 inline const uint256 operator&(const base_uint256& a, const uint256& b) { return (base_uint256)a &  (base_uint256)b; }
 inline const uint256 operator|(const base_uint256& a, const uint256& b) { return (base_uint256)a |  (base_uint256)b; }
 inline const uint256 operator+(const base_uint256& a, const uint256& b) { return (base_uint256)a +  (base_uint256)b; }
 inline const uint256 operator-(const base_uint256& a, const uint256& b) { return (base_uint256)a -  (base_uint256)b; }
-
-inline bool operator<(const uint256& a, const base_uint256& b)          { return (base_uint256)a <  (base_uint256)b; }
-inline bool operator<=(const uint256& a, const base_uint256& b)         { return (base_uint256)a <= (base_uint256)b; }
-inline bool operator>(const uint256& a, const base_uint256& b)          { return (base_uint256)a >  (base_uint256)b; }
-inline bool operator>=(const uint256& a, const base_uint256& b)         { return (base_uint256)a >= (base_uint256)b; }
-inline bool operator==(const uint256& a, const base_uint256& b)         { return (base_uint256)a == (base_uint256)b; }
-inline bool operator!=(const uint256& a, const base_uint256& b)         { return (base_uint256)a != (base_uint256)b; }
+inline const uint256 operator*(const base_uint256& a, const uint256& b) { return (base_uint256)a *  (base_uint256)b; }
+inline const uint256 operator/(const base_uint256& a, const uint256& b) { return (base_uint256)a /  (base_uint256)b; }
+
+constexpr bool operator<(const uint256& a, const base_uint256& b)       { return (const base_uint256&)a <  (const base_uint256&)b; }
+constexpr bool operator<=(const uint256& a, const base_uint256& b)      { return (const base_uint256&)a <= (const base_uint256&)b; }
+constexpr bool operator>(const uint256& a, const base_uint256& b)       { return (const base_uint256&)a >  (const base_uint256&)b; }
+constexpr bool operator>=(const uint256& a, const base_uint256& b)      { return (const base_uint256&)a >= (const base_uint256&)b; }
+constexpr bool operator==(const uint256& a, const base_uint256& b)      { return (const base_uint256&)a == (const base_uint256&)b; }
+constexpr bool operator!=(const uint256& a, const base_uint256& b)      { return (const base_uint256&)a != (const base_uint256&)b; }
 inline const uint256 operator^(const uint256& a, const base_uint256& b) { return (base_uint256)a ^  (base_uint256)b; }
 inline const uint256 operator&(const uint256& a, const base_uint256& b) { return (base_uint256)a &  (base_uint256)b; }
 inline const uint256 operator|(const uint256& a, const base_uint256& b) { return (base_uint256)a |  (base_uint256)b; }
 inline const uint256 operator+(const uint256& a, const base_uint256& b) { return (base_uint256)a +  (base_uint256)b; }
 inline const uint256 operator-(const uint256& a, const base_uint256& b) { return (base_uint256)a -  (base_uint256)b; }
-
-inline bool operator<(const uint256& a, const uint256& b)               { return (base_uint256)a <  (base_uint256)b; }
-inline bool operator<=(const uint256& a, const uint256& b)              { return (base_uint256)a <= (base_uint256)b; }
-inline bool operator>(const uint256& a, const uint256& b)               { return (base_uint256)a >  (base_uint256)b; }
-inline bool operator>=(const uint256& a, const uint256& b)              { return (base_uint256)a >= (base_uint256)b; }
-inline bool operator==(const uint256& a, const uint256& b)              { return (base_uint256)a == (base_uint256)b; }
-inline bool operator!=(const uint256& a, const uint256& b)              { return (base_uint256)a != (base_uint256)b; }
+inline const uint256 operator*(const uint256& a, const base_uint256& b) { return (base_uint256)a *  (base_uint256)b; }
+inline const uint256 operator/(const uint256& a, const base_uint256& b) { return (base_uint256)a /  (base_uint256)b; }
+
+constexpr bool operator<(const uint256& a, const uint256& b)            { return (const base_uint256&)a <  (const base_uint256&)b; }
+constexpr bool operator<=(const uint256& a, const uint256& b)           { return (const base_uint256&)a <= (const base_uint256&)b; }
+constexpr bool operator>(const uint256& a, const uint256& b)            { return (const base_uint256&)a >  (const base_uint256&)b; }
+constexpr bool operator>=(const uint256& a, const uint256& b)           { return (const base_uint256&)a >= (const base_uint256&)b; }
+constexpr bool operator==(const uint256& a, const uint256& b)           { return (const base_uint256&)a == (const base_uint256&)b; }
+constexpr bool operator!=(const uint256& a, const uint256& b)           { return (const base_uint256&)a != (const base_uint256&)b; }
 inline const uint256 operator^(const uint256& a, const uint256& b)      { return (base_uint256)a ^  (base_uint256)b; }
 inline const uint256 operator&(const uint256& a, const uint256& b)      { return (base_uint256)a &  (base_uint256)b; }
 inline const uint256 operator|(const uint256& a, const uint256& b)      { return (base_uint256)a |  (base_uint256)b; }
 inline const uint256 operator+(const uint256& a, const uint256& b)      { return (base_uint256)a +  (base_uint256)b; }
 inline const uint256 operator-(const uint256& a, const uint256& b)      { return (base_uint256)a -  (base_uint256)b; }
+inline const uint256 operator*(const uint256& a, const uint256& b)      { return (base_uint256)a *  (base_uint256)b; }
+inline const uint256 operator/(const uint256& a, const uint256& b)      { return (base_uint256)a /  (base_uint256)b; }
+inline const uint256 operator*(const uint256& a, uint32_t b)            { return (base_uint256)a *  b; }
+
+// Exactly 64 hex digits, most significant first, with no "0x". Being
+// constexpr, a literal is parsed by the compiler and a bad one fails the build:
+//   static constexpr uint256 hash = "..."_uint256;
+// Strings known only at run time go through the std::string constructor
+constexpr uint256 operator""_uint256(const char* psz, size_t n)
+{
+    return n == 64 ? uint256(psz, std::make_index_sequence<8>()) :
+           throw uint_error("operator\"\"_uint256 : not 64 hex digits");
+}
+
+
+// Hex of nCount values, each followed by chSep (e.g. '\n' or ','), into psz,
+// which needs room for nCount * (T::HEX_SIZE + 1) chars. Nothing is
+// allocated and no NUL is added. Returns the end of the output.
+template<typename T>
+char* GetHexBatch(const T* pbegin, size_t nCount, char* psz, char chSep)
+{
+    for (size_t i = 0; i < nCount; i++)
+    {
+        pbegin[i].GetHex(psz);
+        psz[T::HEX_SIZE] = chSep;
+        psz += T::HEX_SIZE + 1;
+    }
+    return psz;
+}
 
 #endif
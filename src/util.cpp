@@ -1,8 +1,8 @@
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <vector>
 #include <string>
-#include <boost/regex.hpp>
 #include <boost/foreach.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -18,6 +18,23 @@ using namespace std;
 map<string, string> mapArgs;
 map<string, vector<string> > mapMultiArgs;
 
+// The command line as parsed, which ReloadConfigFile() starts from
+static map<string, string> mapCmdLineArgs;
+static map<string, vector<string> > mapCmdLineMultiArgs;
+
+// Set while ReloadConfigFile() runs its adjustments, which are published
+// together once they are all done
+static bool fSyncDeferred = false;
+
+// A bare -foo is true, otherwise the number after the '='
+static bool InterpretBool(const string& strValue)
+{
+	if (strValue.empty())
+		return true;
+
+	return atoi(strValue.c_str()) != 0;
+}
+
 // Interpret -nofoo as -foo=0; -nofoo=0 as -foo=1 as long
 // as -foo is not set.
 static void InterpretNegativeSettings(string singleDashArgName, map<string, string>& map)
@@ -33,32 +50,35 @@ static void InterpretNegativeSettings(string singleDashArgName, map<string, stri
 	if (map.count(positive) != 0)
 		return;
 
-	bool val = !GetBoolArg(name, false);
+	bool val = !InterpretBool(map[name]);
 	map[positive] = (val ? "1" : "0");
 	map.erase(name);
 }
 
 bool GetBoolArg(const string& argName, bool fDefault)
 {
-	if (mapArgs.count(argName) == 0)
-		return fDefault;
+	CSettingsSnapshotRef snapshot;
 
-	string argVal = mapArgs[argName];
-	if (argVal.empty())
-		return true;
+	map<string, string>::const_iterator it = snapshot->mapArgs.find(argName);
+	if (it == snapshot->mapArgs.end())
+		return fDefault;
 
-	int n = atoi(argVal.c_str());
-	return n != 0;
+	return InterpretBool(it->second);
 }
 
 bool SoftSetArg(const string& arg, const string& val)
 {
-	if (mapArgs.count(arg))
+	pair<map<string, string>::iterator, bool> ret = mapArgs.insert(make_pair(arg, val));
+	if (!ret.second)
 	{
 		return false;
 	}
 
-	mapArgs[arg] = val;
+	if (!fSyncDeferred)
+	{
+		SyncSettings();
+	}
+
 	return true;
 }
 
@@ -118,9 +138,9 @@ const fs::path& GetDataDir(bool fNetSpecific)
 		return path;
 	}
 
-	if (mapArgs.count("-datadir"))
+	if (IsArgSet(SETTING_DATADIR))
 	{
-		path = fs::system_complete(mapArgs["-datadir"]);
+		path = fs::system_complete(GetArg(SETTING_DATADIR));
 		if (!fs::is_directory(path))
 		{
 			path = "";
@@ -144,7 +164,7 @@ void ClearDataDirCache()
 
 fs::path GetConfigFile()
 {
-	string configFileStr = GetArg("-conf", "bitcoin.conf");
+	string configFileStr = GetArg(SETTING_CONF);
 	fs::path configFile(configFileStr);
 
 	if (!configFile.is_complete())
@@ -155,8 +175,8 @@ fs::path GetConfigFile()
 	return configFile;
 }
 
-void ReadConfigFile(map<string, string>& mapSettingsReg,
-		    map<string, vector<string> >& mapMultiSettingsReg)
+static void ParseConfigFile(map<string, string>& mapSettingsReg,
+			    map<string, vector<string> >& mapMultiSettingsReg)
 {
 	fs::path file = GetConfigFile();
 
@@ -183,8 +203,92 @@ void ReadConfigFile(map<string, string>& mapSettingsReg,
 
 		mapMultiSettingsReg[key].push_back(it->value[0]);
 	}
+}
 
+void ReadConfigFile(map<string, string>& mapSettingsReg,
+		    map<string, vector<string> >& mapMultiSettingsReg)
+{
+	ParseConfigFile(mapSettingsReg, mapMultiSettingsReg);
 	ClearDataDirCache();
+
+	// Readers go through the published snapshot, so the global maps take
+	// effect only once published
+	if (&mapSettingsReg == &mapArgs && !fSyncDeferred)
+	{
+		SyncSettings();
+	}
+}
+
+// Options that pick the data directory, the config file or the network;
+// everything built on them lives until restart, so a reload keeps them
+static const SettingHandle vStartupSettings[] =
+{
+	SETTING_CONF,
+	SETTING_DATADIR,
+	SETTING_REGTEST,
+	SETTING_TESTNET,
+};
+
+// Give the startup-only options in the reloaded maps their current values
+static void PinStartupSettings(map<string, string>& mapNewArgs,
+			       map<string, vector<string> >& mapNewMultiArgs)
+{
+	for (size_t i = 0; i < sizeof(vStartupSettings) / sizeof(vStartupSettings[0]); i++)
+	{
+		const string& strName = CSettings::Instance().GetName(vStartupSettings[i]);
+
+		map<string, string>::const_iterator it = mapArgs.find(strName);
+		map<string, vector<string> >::const_iterator itMulti = mapMultiArgs.find(strName);
+		bool fSet = (it != mapArgs.end());
+
+		if (fSet == (mapNewArgs.count(strName) != 0) &&
+		    (!fSet || mapNewArgs[strName] == it->second))
+		{
+			continue;
+		}
+
+		cout << "Ignoring " << strName << " in reloaded config file: it only takes effect on restart" << endl;
+
+		mapNewArgs.erase(strName);
+		mapNewMultiArgs.erase(strName);
+		if (fSet)
+			mapNewArgs[strName] = it->second;
+		if (itMulti != mapMultiArgs.end())
+			mapNewMultiArgs[strName] = itMulti->second;
+	}
+}
+
+bool ReloadConfigFile(void (*fnAdjust)())
+{
+	map<string, string> mapNewArgs(mapCmdLineArgs);
+	map<string, vector<string> > mapNewMultiArgs(mapCmdLineMultiArgs);
+
+	// The data directory stays what it was at startup, so its cached path
+	// is left alone: other threads read it without a lock
+	try
+	{
+		ParseConfigFile(mapNewArgs, mapNewMultiArgs);
+	}
+	catch (std::exception& e)
+	{
+		cout << "Error reloading config file: " << e.what() << endl;
+		return false;
+	}
+
+	PinStartupSettings(mapNewArgs, mapNewMultiArgs);
+
+	mapArgs.swap(mapNewArgs);
+	mapMultiArgs.swap(mapNewMultiArgs);
+
+	if (fnAdjust)
+	{
+		fSyncDeferred = true;
+		fnAdjust();
+		fSyncDeferred = false;
+	}
+
+	SyncSettings();
+	return true;
 }
 
 void DumpMap(const map<string, string>& map)
@@ -196,38 +300,155 @@ void DumpMap(const map<string, string>& map)
 	}
 }
 
-void ParseParameters(int argc, const char* const argv[])
+static inline bool IsParamNameChar(char c)
 {
-	mapArgs.clear();
-	mapMultiArgs.clear();
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+	       (c >= '0' && c <= '9') || c == '_';
+}
 
-	for (int i = 1; i < argc; i++)
+// Split str into name and value if it is of the form -foo, --foo,
+// -foo=value or --foo=value, with a name of word characters and a
+// non-empty value (the regex "[-]{1,2}\w+([=].+)?")
+static bool LexParameter(const string& str, string& strName, string& strValue)
+{
+	size_t nLen = str.size();
+	size_t i = 0;
+
+	while (i < nLen && i < 2 && str[i] == '-')
+		i++;
+
+	if (i == 0 || i == nLen || !IsParamNameChar(str[i]))
+		return false;
+
+	while (i < nLen && IsParamNameChar(str[i]))
+		i++;
+
+	if (i == nLen)
+	{
+		strName = str;
+		strValue.clear();
+		return true;
+	}
+
+	if (str[i] != '=' || i + 1 == nLen)
+		return false;
+
+	strName.assign(str, 0, i);
+	strValue.assign(str, i + 1, string::npos);
+	return true;
+}
+
+static void AddParameter(const string& str)
+{
+	string strName;
+	string strValue;
+
+	if (!LexParameter(str, strName, strValue))
+	{
+		cout << "Wrong param: " << str << endl;
+		return;
+	}
+
+	mapArgs[strName] = strValue;
+	mapMultiArgs[strName].push_back(strValue);
+}
+
+// Response files may name further response files, up to this depth
+static const int MAX_RESPONSE_FILE_DEPTH = 8;
+
+// Read parameters from a response file: tokens separated by whitespace,
+// where double quotes keep whitespace inside a token, and a line whose
+// first non-blank character is '#' is a comment. A token starting with an
+// unquoted '@' reads another file, relative to the directory of the file
+// naming it; "@..." in quotes is an ordinary parameter.
+static void AddResponseFile(const string& strPath, int nDepth)
+{
+	if (nDepth > MAX_RESPONSE_FILE_DEPTH)
+	{
+		cout << "Response files nested too deep: " << strPath << endl;
+		return;
+	}
+
+	ifstream stream(strPath.c_str(), ios::in | ios::binary);
+	if (!stream.good())
+	{
+		cout << "Can't read response file: " << strPath << endl;
+		return;
+	}
+
+	string strFile((istreambuf_iterator<char>(stream)), istreambuf_iterator<char>());
+	size_t nLen = strFile.size();
+	size_t i = 0;
+	bool fLineStart = true;
+
+	while (i < nLen)
 	{
-		string str(argv[i]);
+		char c = strFile[i];
 
-		boost::regex regex("[-]{1,2}\\w+([=].+)?");
-		if (!boost::regex_match(str, regex))
+		if (isspace((unsigned char)c))
 		{
-			cout << "Wrong param: " << str << endl;
+			if (c == '\n')
+				fLineStart = true;
+			i++;
 			continue;
 		}
 
-		string strValue;
-		size_t is_index = str.find('=');
-		if (is_index != string::npos)
+		if (c == '#' && fLineStart)
 		{
-			strValue = str.substr(is_index + 1);
-			str = str.substr(0, is_index);
+			i = strFile.find('\n', i);
+			if (i == string::npos)
+				break;
+			continue;
 		}
 
-		if (str[0] != '-')
+		fLineStart = false;
+
+		bool fReference = (c == '@');
+		if (fReference)
+			i++;
+
+		string strToken;
+		bool fQuoted = false;
+		for (; i < nLen && (fQuoted || !isspace((unsigned char)strFile[i])); i++)
 		{
-			cout << "Wrong param!" << endl;
-			break;
+			if (strFile[i] == '"')
+				fQuoted = !fQuoted;
+			else
+				strToken += strFile[i];
 		}
 
-		mapArgs[str] = strValue;
-		mapMultiArgs[str].push_back(strValue);
+		if (!fReference)
+		{
+			AddParameter(strToken);
+		}
+		else if (!strToken.empty())
+		{
+			fs::path path(strToken);
+			if (!path.is_complete())
+				path = fs::path(strPath).parent_path() / path;
+			AddResponseFile(path.string(), nDepth + 1);
+		}
+		else
+		{
+			AddParameter("@");
+		}
+	}
+}
+
+void ParseParameters(int argc, const char* const argv[])
+{
+	mapArgs.clear();
+	mapMultiArgs.clear();
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (argv[i][0] == '@' && argv[i][1] != '\0')
+		{
+			AddResponseFile(argv[i] + 1, 1);
+			continue;
+		}
+
+		AddParameter(argv[i]);
 	}
 
 	map<string, string> tmpMapArgs(mapArgs);
@@ -251,15 +472,41 @@ void ParseParameters(int argc, const char* const argv[])
 
 		InterpretNegativeSettings(name, mapArgs);
 	}
+
+	mapCmdLineArgs = mapArgs;
+	mapCmdLineMultiArgs = mapMultiArgs;
+
+	SyncSettings();
 }
 
 string GetArg(const string& arg, const string& argDefault)
 {
-	if (mapArgs.count(arg))
+	CSettingsSnapshotRef snapshot;
+
+	map<string, string>::const_iterator it = snapshot->mapArgs.find(arg);
+	if (it != snapshot->mapArgs.end())
 	{
-		return mapArgs[arg];
+		return it->second;
 	}
 
 	return argDefault;
 }
 
+bool IsArgSetUnpublished(SettingHandle h)
+{
+	return mapArgs.count(CSettings::Instance().GetName(h)) != 0;
+}
+
+bool GetBoolArgUnpublished(SettingHandle h)
+{
+	CSettings& settings = CSettings::Instance();
+
+	map<string, string>::const_iterator it = mapArgs.find(settings.GetName(h));
+	return InterpretBool(it == mapArgs.end() ? settings.GetDefault(h) : it->second);
+}
+
+void SyncSettings()
+{
+	CSettings::Instance().Publish(mapArgs, mapMultiArgs);
+}
+
@@ -8,6 +8,8 @@
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
+#include "settings.h"
+
 using namespace std;
 
 inline void MilliSleep(int64_t n)
@@ -18,6 +20,8 @@ inline void MilliSleep(int64_t n)
 
 #define LogPrintf(...)
 
+// Only written by the thread that (re)loads the configuration; other
+// threads read the published snapshot through GetArg() and friends
 extern std::map<string, string> mapArgs;
 extern std::map<string, vector<string> > mapMultiArgs;
 
@@ -27,9 +31,18 @@ void ParseParameters(int argc, const char* const argv[]);
 
 boost::filesystem::path GetDefaultDataDir();
 const boost::filesystem::path& GetDataDir(bool fNetSpecific = true);
+boost::filesystem::path GetConfigFile();
+// Add the config file's options to the given maps; given mapArgs and
+// mapMultiArgs, also publishes them
 void ReadConfigFile(map<string, string>& mapSettingsReg,
 		    map<string, vector<string> >& mapMultiSettingsReg);
 
+// Rebuild mapArgs and mapMultiArgs from the command line and the config
+// file as it is now, run fnAdjust (which may SoftSetArg() derived options)
+// and publish the result. On error the current settings are kept.
+// -conf, -datadir, -regtest and -testnet keep their startup values.
+bool ReloadConfigFile(void (*fnAdjust)());
+
 inline bool IsSwitchChar(char c)
 {
 	return c == '-';
@@ -40,5 +53,40 @@ bool SoftSetArg(const string& arg, const string& val);
 bool SoftSetBoolArg(const string& arg, bool set);
 string GetArg(const string& arg, const string& argDefault);
 
+// Publish mapArgs and mapMultiArgs after changing them other than through
+// ParseParameters(), ReadConfigFile() or SoftSetArg()
+void SyncSettings();
+
+// Registered options, by handle; defaults come from the registration
+inline bool IsArgSet(SettingHandle h)
+{
+	return CSettings::Instance().IsSet(h);
+}
+
+inline bool GetBoolArg(SettingHandle h)
+{
+	return CSettings::Instance().GetBool(h);
+}
+
+inline int64_t GetIntArg(SettingHandle h)
+{
+	return CSettings::Instance().GetInt(h);
+}
+
+inline string GetArg(SettingHandle h)
+{
+	return CSettings::Instance().GetString(h);
+}
+
+inline bool SoftSetBoolArg(SettingHandle h, bool set)
+{
+	return SoftSetBoolArg(CSettings::Instance().GetName(h), set);
+}
+
+// From mapArgs itself, which may not be published yet: for the thread that
+// (re)loads the configuration, while it derives options from it
+bool IsArgSetUnpublished(SettingHandle h);
+bool GetBoolArgUnpublished(SettingHandle h);
+
 #endif // BITCOIN_UTIL_H
 